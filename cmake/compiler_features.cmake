@@ -3,5 +3,6 @@ if(NOT TARGET compiler_features)
 
     target_compile_features(compiler_features INTERFACE cxx_std_20)
 
-    set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} /openmp")
+    find_package(Threads REQUIRED)
+    target_link_libraries(compiler_features INTERFACE Threads::Threads)
 endif()
\ No newline at end of file
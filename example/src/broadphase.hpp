@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "particles.hpp"
+
+struct SpatialPartition;
+
+// Candidate pairs in compressed rows. Row `id` holds the partners of `id`
+// that have a higher index, so every pair is stored exactly once.
+struct CandidateList {
+	std::vector<int> partnerStart;
+	std::vector<int> partners;
+
+	int size() const { return static_cast<int>(partners.size()); }
+
+	void reset(int count) {
+		partnerStart.assign(count + 1, 0);
+		partners.clear();
+	}
+
+	void beginRow(int id) { partnerStart[id] = size(); }
+
+	void endRows(int count) { partnerStart[count] = size(); }
+
+	// Sorts (a, b) pairs with a < b into rows with a counting sort. Rows are
+	// sorted by partner index as well, the serial solve settles noticeably
+	// worse when partners are visited in arbitrary order.
+	void assign(int count, const std::vector<std::pair<int, int>>& pairs) {
+		partnerStart.assign(count + 1, 0);
+		partners.resize(pairs.size());
+		for (const auto& pair : pairs) {
+			++partnerStart[pair.first];
+		}
+		for (int i = 1; i <= count; ++i) {
+			partnerStart[i] += partnerStart[i - 1];
+		}
+		for (int i = static_cast<int>(pairs.size()) - 1; i >= 0; --i) {
+			partners[--partnerStart[pairs[i].first]] = pairs[i].second;
+		}
+		for (int id = 0; id < count; ++id) {
+			std::sort(partners.begin() + partnerStart[id],
+			          partners.begin() + partnerStart[id + 1]);
+		}
+	}
+
+	// Drops every pair that is further apart than their radii plus `margin`.
+	void prune(const Particles& particles, float margin) {
+		const int count = static_cast<int>(partnerStart.size()) - 1;
+
+		int write = 0;
+		for (int id = 0; id < count; ++id) {
+			const int       begin    = partnerStart[id];
+			const int       end      = partnerStart[id + 1];
+			const glm::vec2 position = particles.getPosition(id);
+			const float     radius   = particles.radius[id] + margin;
+
+			partnerStart[id] = write;
+			for (int i = begin; i < end; ++i) {
+				const int   other = partners[i];
+				const auto  axis  = position - particles.getPosition(other);
+				const float range = radius + particles.radius[other];
+				if (glm::dot(axis, axis) < range * range) {
+					partners[write++] = other;
+				}
+			}
+		}
+		if (count >= 0) {
+			partnerStart[count] = write;
+		}
+		partners.resize(write);
+	}
+
+	template <typename Fn>
+	void apply(int id, Fn fn) const {
+		for (int i = partnerStart[id]; i < partnerStart[id + 1]; ++i) {
+			fn(partners[i]);
+		}
+	}
+};
+
+// Offsets of the neighbors a grid cell is paired with. Together with pairing
+// every cell with itself, this visits each pair of adjacent cells once.
+inline constexpr std::array<glm::ivec2, 4> HalfStencil = {
+    glm::ivec2{1, 0},
+    glm::ivec2{-1, 1},
+    glm::ivec2{0, 1},
+    glm::ivec2{1, 1},
+};
+
+// Appends every pair between the particles of two cells whose bounding
+// boxes overlap once their radii are grown by `margin`, unless both are at
+// or past `numAwake`. Passing the same cell twice pairs its particles with
+// each other.
+template <typename Objects>
+void findPairs(const Particles&                  particles,
+               int                               numAwake,
+               float                             margin,
+               const Objects&                    a,
+               const Objects&                    b,
+               std::vector<std::pair<int, int>>& pairs) {
+	const bool   same = std::data(a) == std::data(b);
+	const size_t numA = std::size(a);
+	const size_t numB = std::size(b);
+	for (size_t i = 0; i < numA; ++i) {
+		const int       id       = a[i];
+		const glm::vec2 position = particles.getPosition(id);
+		const float     radius   = particles.radius[id] + margin;
+		for (size_t j = same ? i + 1 : 0; j < numB; ++j) {
+			const int other = b[j];
+			if (id >= numAwake && other >= numAwake) continue;
+
+			const float range = radius + particles.radius[other] + margin;
+			const auto  d = glm::abs(position - particles.getPosition(other));
+			if (d.x <= range && d.y <= range) {
+				pairs.emplace_back(std::min(id, other), std::max(id, other));
+			}
+		}
+	}
+}
+
+class Broadphase {
+public:
+	virtual ~Broadphase() = default;
+
+	// Fills `candidates` with every pair of particles whose bounding boxes
+	// overlap once their radii are grown by `margin`. The particles from
+	// `numAwake` on are asleep, pairs of two of them are left out.
+	virtual void findCandidates(const Particles& particles,
+	                            int              numAwake,
+	                            float            mapRadius,
+	                            float            margin,
+	                            CandidateList&   candidates) = 0;
+
+	// Called when the particles have been reordered in memory.
+	virtual void invalidate() {}
+
+	// Writes broadphase specific statistics for the debug window. Runs on the
+	// simulation thread, the text is shown by the UI thread later.
+	virtual void printStats(char* text, size_t size) const {
+		if (size > 0) text[0] = '\0';
+	}
+
+	// The uniform grid the candidates were found with, if there is one.
+	virtual const SpatialPartition* getPartition() const { return nullptr; }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+
+// Multi-level grid for scenes where the radii differ by orders of magnitude.
+// Level 0 cells fit the smallest particle and every further level doubles the
+// cell size. Each particle is inserted once, by its center, into the first
+// level whose cells are at least its diameter. A particle then only has to
+// look at the 3x3 neighborhood of its own cell on its own level and on every
+// coarser level, which finds each pair exactly once from its smaller side.
+class HierarchicalGrid : public Broadphase {
+	struct Level {
+		float            cellSize   = 0.f;
+		glm::vec2        origin     = {};
+		glm::ivec2       dimensions = {};
+		int              count      = 0;
+		std::vector<int> cellStart;
+		std::vector<int> cellObjects;
+
+		glm::ivec2 getCell(glm::vec2 p) const {
+			return glm::clamp(glm::ivec2(glm::floor((p - origin) / cellSize)),
+			                  glm::ivec2(0),
+			                  dimensions - glm::ivec2(1));
+		}
+	};
+
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		const int count = particles.size();
+		if (count == 0) {
+			candidates.reset(0);
+			return;
+		}
+
+		const auto minRadius =
+		    std::min_element(particles.radius.begin(), particles.radius.end());
+		const float baseSize = std::max(1.f, 2.f * (*minRadius + margin));
+
+		numLevels = 1;
+		levelOf.resize(count);
+		for (int id = 0; id < count; ++id) {
+			const float diameter = 2.f * (particles.radius[id] + margin);
+
+			int   level    = 0;
+			float cellSize = baseSize;
+			while (cellSize < diameter) {
+				cellSize *= 2.f;
+				++level;
+			}
+			levelOf[id] = level;
+			numLevels   = std::max(numLevels, level + 1);
+		}
+		if (static_cast<int>(levels.size()) < numLevels) {
+			levels.resize(numLevels);
+		}
+
+		float cellSize = baseSize;
+		for (int l = 0; l < numLevels; ++l) {
+			buildLevel(particles, l, cellSize, mapRadius);
+			cellSize *= 2.f;
+		}
+
+		pairs.clear();
+		for (int id = 0; id < count; ++id) {
+			for (int l = levelOf[id]; l < numLevels; ++l) {
+				if (levels[l].count > 0) {
+					findPairs(particles, numAwake, margin, id, l);
+				}
+			}
+		}
+
+		candidates.assign(count, pairs);
+	}
+
+private:
+	void findPairs(const Particles& particles,
+	               int              numAwake,
+	               float            margin,
+	               int              id,
+	               int              l) {
+		const Level&     level    = levels[l];
+		const glm::vec2  position = particles.getPosition(id);
+		const float      radius   = particles.radius[id] + margin;
+		const glm::ivec2 cell     = level.getCell(position);
+		const glm::ivec2 min      = glm::max(cell - glm::ivec2(1), glm::ivec2(0));
+		const glm::ivec2 max =
+		    glm::min(cell + glm::ivec2(1), level.dimensions - glm::ivec2(1));
+
+		for (int y = min.y; y <= max.y; ++y) {
+			for (int x = min.x; x <= max.x; ++x) {
+				const int c = x + y * level.dimensions.x;
+				for (int i = level.cellStart[c]; i < level.cellStart[c + 1]; ++i) {
+					const int other = level.cellObjects[i];
+					if (l == levelOf[id] && other <= id) continue;
+					if (id >= numAwake && other >= numAwake) continue;
+
+					const float range =
+					    radius + particles.radius[other] + margin;
+					const auto d =
+					    glm::abs(position - particles.getPosition(other));
+					if (d.x <= range && d.y <= range) {
+						pairs.emplace_back(std::min(id, other),
+						                   std::max(id, other));
+					}
+				}
+			}
+		}
+	}
+
+	void buildLevel(const Particles& particles,
+	                int              l,
+	                float            cellSize,
+	                float            mapRadius) {
+		Level& level = levels[l];
+
+		const float extent = mapRadius + cellSize;
+		level.cellSize     = cellSize;
+		level.origin       = glm::vec2(-extent, -extent);
+		level.dimensions   = glm::ivec2(
+		    std::max(1, static_cast<int>(std::ceil(2.f * extent / cellSize))));
+
+		const int numCells = level.dimensions.x * level.dimensions.y;
+		level.cellStart.assign(numCells + 1, 0);
+		level.count = 0;
+
+		const int count = particles.size();
+		for (int id = 0; id < count; ++id) {
+			if (levelOf[id] != l) continue;
+			const glm::ivec2 cell = level.getCell(particles.getPosition(id));
+			++level.cellStart[cell.x + cell.y * level.dimensions.x];
+			++level.count;
+		}
+		for (int i = 1; i <= numCells; ++i) {
+			level.cellStart[i] += level.cellStart[i - 1];
+		}
+		level.cellObjects.resize(level.count);
+		for (int id = count - 1; id >= 0; --id) {
+			if (levelOf[id] != l) continue;
+			const glm::ivec2 cell = level.getCell(particles.getPosition(id));
+			const int        c    = cell.x + cell.y * level.dimensions.x;
+			level.cellObjects[--level.cellStart[c]] = id;
+		}
+	}
+
+	std::vector<Level>               levels;
+	std::vector<int>                 levelOf;
+	std::vector<std::pair<int, int>> pairs;
+	int                              numLevels = 0;
+};
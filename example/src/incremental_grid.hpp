@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+#include "spatial_partition.hpp"
+
+// Single-insertion grid that is kept between updates. Every particle
+// remembers its cell and its index within that cell, so only the particles
+// whose cell changed are moved, with a swap-remove from the old cell. The
+// grid is rebuilt from scratch when its layout changes or the particles are
+// reordered.
+class IncrementalGrid : public Broadphase {
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		const int count = particles.size();
+
+		float maxRadius = 0.f;
+		for (float r : particles.radius) {
+			maxRadius = std::max(maxRadius, r);
+		}
+		const float      size   = std::max(CellSize, 2.f * (maxRadius + margin));
+		const float      extent = mapRadius + size;
+		const glm::ivec2 dims   = glm::ivec2(
+		    std::max(1, static_cast<int>(std::ceil(2.f * extent / size))));
+
+		if (size != cellSize || dims != dimensions ||
+		    count < static_cast<int>(cellOf.size())) {
+			cellSize   = size;
+			origin     = glm::vec2(-extent, -extent);
+			dimensions = dims;
+			reset();
+		}
+
+		numMigrated = 0;
+		for (int id = 0; id < static_cast<int>(cellOf.size()); ++id) {
+			const int cell = getCell(particles.getPosition(id));
+			if (cell != cellOf[id]) {
+				remove(id);
+				insert(id, cell);
+				++numMigrated;
+			}
+		}
+		while (static_cast<int>(cellOf.size()) < count) {
+			const int id = static_cast<int>(cellOf.size());
+			cellOf.push_back(-1);
+			indexInCell.push_back(-1);
+			insert(id, getCell(particles.getPosition(id)));
+		}
+
+		pairs.clear();
+		for (int y = 0; y < dimensions.y; ++y) {
+			for (int x = 0; x < dimensions.x; ++x) {
+				const int cell = x + y * dimensions.x;
+				if (cells[cell].empty()) continue;
+
+				findPairs(particles,
+				          numAwake,
+				          margin,
+				          cells[cell],
+				          cells[cell],
+				          pairs);
+				for (const auto& offset : HalfStencil) {
+					const glm::ivec2 neighbor = glm::ivec2(x, y) + offset;
+					if (neighbor.x < 0 || neighbor.x >= dimensions.x ||
+					    neighbor.y >= dimensions.y) {
+						continue;
+					}
+					findPairs(particles,
+					          numAwake,
+					          margin,
+					          cells[cell],
+					          cells[neighbor.x + neighbor.y * dimensions.x],
+					          pairs);
+				}
+			}
+		}
+
+		candidates.assign(count, pairs);
+	}
+
+	void invalidate() override { cellSize = 0.f; }
+
+	void printStats(char* text, size_t size) const override {
+		std::snprintf(text,
+		              size,
+		              "Migrated Particles (last substep): %d",
+		              numMigrated);
+	}
+
+private:
+	void reset() {
+		cells.resize(dimensions.x * dimensions.y);
+		for (auto& objects : cells) {
+			objects.clear();
+		}
+		cellOf.clear();
+		indexInCell.clear();
+	}
+
+	int getCell(glm::vec2 p) const {
+		const glm::ivec2 cell =
+		    glm::clamp(glm::ivec2(glm::floor((p - origin) / cellSize)),
+		               glm::ivec2(0),
+		               dimensions - glm::ivec2(1));
+		return cell.x + cell.y * dimensions.x;
+	}
+
+	void insert(int id, int cell) {
+		cellOf[id]      = cell;
+		indexInCell[id] = static_cast<int>(cells[cell].size());
+		cells[cell].push_back(id);
+	}
+
+	void remove(int id) {
+		auto&     objects = cells[cellOf[id]];
+		const int last    = objects.back();
+		objects[indexInCell[id]] = last;
+		indexInCell[last]        = indexInCell[id];
+		objects.pop_back();
+	}
+
+	float                            cellSize   = 0.f;
+	glm::vec2                        origin     = {};
+	glm::ivec2                       dimensions = {};
+	std::vector<std::vector<int>>    cells;
+	std::vector<int>                 cellOf;
+	std::vector<int>                 indexInCell;
+	std::vector<std::pair<int, int>> pairs;
+	int                              numMigrated = 0;
+};
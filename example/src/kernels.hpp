@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include <glm/glm.hpp>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#	define VERLET_X86
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+// MSVC allows every intrinsic in any function, GCC and Clang need the target
+// of the function to include the instruction set.
+#if defined(__GNUC__)
+#	define VERLET_TARGET(isa) __attribute__((target(isa)))
+#else
+#	define VERLET_TARGET(isa)
+#endif
+
+// Particle kernels over structure-of-arrays storage. Every kernel is compiled
+// once per instruction set level and the widest level the CPU supports is
+// picked at startup, so one binary runs everywhere.
+
+enum class Isa : int {
+	Scalar,
+	Sse42,
+	Avx2,
+	Avx512,
+};
+
+struct Kernels {
+	Isa isa;
+	void (*accelerate)(float*, float*, int, glm::vec2);
+	void (*integrate)(
+	    float*, float*, float*, float*, float*, float*, int, float);
+	float (*maxDisplacement2)(
+	    const float*, const float*, const float*, const float*, int);
+	void (*scaleVelocities)(
+	    const float*, const float*, float*, float*, int, float);
+	void (*constrain)(float*, float*, const float*, int, glm::vec2, float);
+	int (*solveContacts)(float*, float*, const float*, int, const int*, int);
+	void (*smoothUnion)(float*,
+	                    const float*,
+	                    const float*,
+	                    int,
+	                    const float*,
+	                    const float*,
+	                    const float*,
+	                    int,
+	                    float);
+};
+
+#define VERLET_KERNELS_NAMESPACE kernels_scalar
+#define VERLET_KERNELS_ISA Isa::Scalar
+#define VERLET_KERNEL
+#include "kernels_impl.hpp"
+
+#if defined(VERLET_X86)
+#	define VERLET_KERNELS_NAMESPACE kernels_sse42
+#	define VERLET_KERNELS_ISA Isa::Sse42
+#	define VERLET_KERNEL VERLET_TARGET("sse4.2")
+#	define VERLET_SIMD_SSE
+#	include "kernels_impl.hpp"
+
+#	define VERLET_KERNELS_NAMESPACE kernels_avx2
+#	define VERLET_KERNELS_ISA Isa::Avx2
+#	define VERLET_KERNEL VERLET_TARGET("avx2")
+#	define VERLET_SIMD_AVX2
+#	include "kernels_impl.hpp"
+
+#	define VERLET_KERNELS_NAMESPACE kernels_avx512
+#	define VERLET_KERNELS_ISA Isa::Avx512
+#	define VERLET_KERNEL VERLET_TARGET("avx512f")
+#	define VERLET_SIMD_AVX512
+#	include "kernels_impl.hpp"
+#endif
+
+#if defined(VERLET_X86)
+struct CpuidRegisters {
+	uint32_t eax = 0;
+	uint32_t ebx = 0;
+	uint32_t ecx = 0;
+	uint32_t edx = 0;
+};
+
+inline CpuidRegisters cpuid(uint32_t leaf) {
+	CpuidRegisters r;
+#	if defined(_MSC_VER)
+	int registers[4];
+	__cpuidex(registers, static_cast<int>(leaf), 0);
+	r = {static_cast<uint32_t>(registers[0]),
+	     static_cast<uint32_t>(registers[1]),
+	     static_cast<uint32_t>(registers[2]),
+	     static_cast<uint32_t>(registers[3])};
+#	else
+	__cpuid_count(leaf, 0, r.eax, r.ebx, r.ecx, r.edx);
+#	endif
+	return r;
+}
+
+// The register states the operating system saves on a context switch, the
+// wider registers are unusable unless it saves them.
+VERLET_TARGET("xsave") inline uint64_t getEnabledStates() {
+	return static_cast<uint64_t>(_xgetbv(0));
+}
+#endif
+
+inline bool isSupported(Isa isa) {
+	if (isa == Isa::Scalar) return true;
+#if defined(VERLET_X86)
+	static constexpr uint64_t YmmStates = 0x6;
+	static constexpr uint64_t ZmmStates = 0xe6;
+
+	const uint32_t       maxLeaf = cpuid(0).eax;
+	const CpuidRegisters leaf1   = cpuid(1);
+	const CpuidRegisters leaf7   = maxLeaf >= 7 ? cpuid(7) : CpuidRegisters{};
+
+	const bool sse42   = leaf1.ecx >> 20 & 1;
+	const bool osxsave = leaf1.ecx >> 27 & 1;
+	const bool avx     = leaf1.ecx >> 28 & 1;
+	const bool avx2    = leaf7.ebx >> 5 & 1;
+	const bool avx512f = leaf7.ebx >> 16 & 1;
+
+	const uint64_t states = osxsave && avx ? getEnabledStates() : 0;
+	switch (isa) {
+	case Isa::Sse42:
+		return sse42;
+	case Isa::Avx2:
+		return avx2 && (states & YmmStates) == YmmStates;
+	case Isa::Avx512:
+		return avx512f && (states & ZmmStates) == ZmmStates;
+	default:
+		break;
+	}
+#endif
+	return false;
+}
+
+inline const Kernels& getKernels(Isa isa) {
+#if defined(VERLET_X86)
+	switch (isa) {
+	case Isa::Sse42:
+		return kernels_sse42::table;
+	case Isa::Avx2:
+		return kernels_avx2::table;
+	case Isa::Avx512:
+		return kernels_avx512::table;
+	default:
+		break;
+	}
+#endif
+	(void)isa;
+	return kernels_scalar::table;
+}
+
+inline const char* getIsaName(Isa isa) {
+	switch (isa) {
+	case Isa::Sse42:
+		return "SSE4.2";
+	case Isa::Avx2:
+		return "AVX2";
+	case Isa::Avx512:
+		return "AVX-512";
+	default:
+		return "Scalar";
+	}
+}
+
+// Accepts the names used on the command line: scalar, sse4.2, avx2, avx512.
+inline std::optional<Isa> parseIsa(std::string_view name) {
+	if (name == "scalar") return Isa::Scalar;
+	if (name == "sse4.2") return Isa::Sse42;
+	if (name == "avx2") return Isa::Avx2;
+	if (name == "avx512") return Isa::Avx512;
+	return std::nullopt;
+}
+
+inline Isa detectIsa() {
+	for (Isa isa : {Isa::Avx512, Isa::Avx2, Isa::Sse42}) {
+		if (isSupported(isa)) return isa;
+	}
+	return Isa::Scalar;
+}
+
+inline const Isa      detectedIsa   = detectIsa();
+inline const Kernels* activeKernels = &getKernels(detectedIsa);
+
+// Switches every kernel to `isa`, unless the CPU does not support it.
+inline bool selectIsa(Isa isa) {
+	if (!isSupported(isa)) return false;
+	activeKernels = &getKernels(isa);
+	return true;
+}
+
+inline Isa getActiveIsa() { return activeKernels->isa; }
+
+inline const char* getSimdName() { return getIsaName(getActiveIsa()); }
+
+inline void accelerate(
+    float* accelerationX, float* accelerationY, int count, glm::vec2 acc) {
+	activeKernels->accelerate(accelerationX, accelerationY, count, acc);
+}
+
+inline void integrate(float* currentX,
+                      float* currentY,
+                      float* previousX,
+                      float* previousY,
+                      float* accelerationX,
+                      float* accelerationY,
+                      int    count,
+                      float  dt) {
+	activeKernels->integrate(currentX,
+	                         currentY,
+	                         previousX,
+	                         previousY,
+	                         accelerationX,
+	                         accelerationY,
+	                         count,
+	                         dt);
+}
+
+inline float maxDisplacement2(const float* currentX,
+                              const float* currentY,
+                              const float* previousX,
+                              const float* previousY,
+                              int          count) {
+	return activeKernels->maxDisplacement2(
+	    currentX, currentY, previousX, previousY, count);
+}
+
+inline void scaleVelocities(const float* currentX,
+                            const float* currentY,
+                            float*       previousX,
+                            float*       previousY,
+                            int          count,
+                            float        scale) {
+	activeKernels->scaleVelocities(
+	    currentX, currentY, previousX, previousY, count, scale);
+}
+
+inline void constrain(float*       currentX,
+                      float*       currentY,
+                      const float* radius,
+                      int          count,
+                      glm::vec2    center,
+                      float        mapRadius) {
+	activeKernels->constrain(
+	    currentX, currentY, radius, count, center, mapRadius);
+}
+
+inline int solveContacts(float*       currentX,
+                         float*       currentY,
+                         const float* radius,
+                         int          id,
+                         const int*   others,
+                         int          count) {
+	return activeKernels->solveContacts(
+	    currentX, currentY, radius, id, others, count);
+}
+
+inline void smoothUnion(float*       values,
+                        const float* pointX,
+                        const float* pointY,
+                        int          count,
+                        const float* circleX,
+                        const float* circleY,
+                        const float* circleRadius,
+                        int          numCircles,
+                        float        k) {
+	activeKernels->smoothUnion(values,
+	                           pointX,
+	                           pointY,
+	                           count,
+	                           circleX,
+	                           circleY,
+	                           circleRadius,
+	                           numCircles,
+	                           k);
+}
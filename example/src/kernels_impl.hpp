@@ -0,0 +1,645 @@
+// No include guard: kernels.hpp includes this file once per instruction set
+// level, each time with VERLET_KERNELS_NAMESPACE, VERLET_KERNEL and one of
+// the VERLET_SIMD_* macros defined. VERLET_KERNEL marks every function with
+// the target of its level, so the whole program can be compiled for the
+// baseline and still contain the wider paths.
+//
+// Each kernel processes as many particles as possible with the widest vector
+// width of its level and finishes the remainder with the scalar path, which
+// performs the exact same sequence of operations per particle.
+
+namespace VERLET_KERNELS_NAMESPACE {
+
+VERLET_KERNEL inline void accelerate(float*    accelerationX,
+                                     float*    accelerationY,
+                                     int       count,
+                                     glm::vec2 acc) {
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	const __m512 ax = _mm512_set1_ps(acc.x);
+	const __m512 ay = _mm512_set1_ps(acc.y);
+	for (; i + 16 <= count; i += 16) {
+		_mm512_storeu_ps(
+		    accelerationX + i,
+		    _mm512_add_ps(_mm512_loadu_ps(accelerationX + i), ax));
+		_mm512_storeu_ps(
+		    accelerationY + i,
+		    _mm512_add_ps(_mm512_loadu_ps(accelerationY + i), ay));
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	const __m256 ax = _mm256_set1_ps(acc.x);
+	const __m256 ay = _mm256_set1_ps(acc.y);
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(
+		    accelerationX + i,
+		    _mm256_add_ps(_mm256_loadu_ps(accelerationX + i), ax));
+		_mm256_storeu_ps(
+		    accelerationY + i,
+		    _mm256_add_ps(_mm256_loadu_ps(accelerationY + i), ay));
+	}
+#elif defined(VERLET_SIMD_SSE)
+	const __m128 ax = _mm_set1_ps(acc.x);
+	const __m128 ay = _mm_set1_ps(acc.y);
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(accelerationX + i,
+		              _mm_add_ps(_mm_loadu_ps(accelerationX + i), ax));
+		_mm_storeu_ps(accelerationY + i,
+		              _mm_add_ps(_mm_loadu_ps(accelerationY + i), ay));
+	}
+#endif
+	for (; i < count; ++i) {
+		accelerationX[i] += acc.x;
+		accelerationY[i] += acc.y;
+	}
+}
+
+VERLET_KERNEL inline void integrate(float* currentX,
+                                    float* currentY,
+                                    float* previousX,
+                                    float* previousY,
+                                    float* accelerationX,
+                                    float* accelerationY,
+                                    int    count,
+                                    float  dt) {
+	const float dt2 = dt * dt;
+
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	const __m512 vdt2 = _mm512_set1_ps(dt2);
+	const __m512 zero = _mm512_setzero_ps();
+	for (; i + 16 <= count; i += 16) {
+		const __m512 cx = _mm512_loadu_ps(currentX + i);
+		const __m512 cy = _mm512_loadu_ps(currentY + i);
+		const __m512 vx = _mm512_sub_ps(cx, _mm512_loadu_ps(previousX + i));
+		const __m512 vy = _mm512_sub_ps(cy, _mm512_loadu_ps(previousY + i));
+		const __m512 ax = _mm512_loadu_ps(accelerationX + i);
+		const __m512 ay = _mm512_loadu_ps(accelerationY + i);
+
+		_mm512_storeu_ps(previousX + i, cx);
+		_mm512_storeu_ps(previousY + i, cy);
+		_mm512_storeu_ps(
+		    currentX + i,
+		    _mm512_add_ps(cx, _mm512_add_ps(vx, _mm512_mul_ps(ax, vdt2))));
+		_mm512_storeu_ps(
+		    currentY + i,
+		    _mm512_add_ps(cy, _mm512_add_ps(vy, _mm512_mul_ps(ay, vdt2))));
+		_mm512_storeu_ps(accelerationX + i, zero);
+		_mm512_storeu_ps(accelerationY + i, zero);
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	const __m256 vdt2 = _mm256_set1_ps(dt2);
+	const __m256 zero = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		const __m256 cx = _mm256_loadu_ps(currentX + i);
+		const __m256 cy = _mm256_loadu_ps(currentY + i);
+		const __m256 vx = _mm256_sub_ps(cx, _mm256_loadu_ps(previousX + i));
+		const __m256 vy = _mm256_sub_ps(cy, _mm256_loadu_ps(previousY + i));
+		const __m256 ax = _mm256_loadu_ps(accelerationX + i);
+		const __m256 ay = _mm256_loadu_ps(accelerationY + i);
+
+		_mm256_storeu_ps(previousX + i, cx);
+		_mm256_storeu_ps(previousY + i, cy);
+		_mm256_storeu_ps(
+		    currentX + i,
+		    _mm256_add_ps(cx, _mm256_add_ps(vx, _mm256_mul_ps(ax, vdt2))));
+		_mm256_storeu_ps(
+		    currentY + i,
+		    _mm256_add_ps(cy, _mm256_add_ps(vy, _mm256_mul_ps(ay, vdt2))));
+		_mm256_storeu_ps(accelerationX + i, zero);
+		_mm256_storeu_ps(accelerationY + i, zero);
+	}
+#elif defined(VERLET_SIMD_SSE)
+	const __m128 vdt2 = _mm_set1_ps(dt2);
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		const __m128 cx = _mm_loadu_ps(currentX + i);
+		const __m128 cy = _mm_loadu_ps(currentY + i);
+		const __m128 vx = _mm_sub_ps(cx, _mm_loadu_ps(previousX + i));
+		const __m128 vy = _mm_sub_ps(cy, _mm_loadu_ps(previousY + i));
+		const __m128 ax = _mm_loadu_ps(accelerationX + i);
+		const __m128 ay = _mm_loadu_ps(accelerationY + i);
+
+		_mm_storeu_ps(previousX + i, cx);
+		_mm_storeu_ps(previousY + i, cy);
+		_mm_storeu_ps(currentX + i,
+		              _mm_add_ps(cx, _mm_add_ps(vx, _mm_mul_ps(ax, vdt2))));
+		_mm_storeu_ps(currentY + i,
+		              _mm_add_ps(cy, _mm_add_ps(vy, _mm_mul_ps(ay, vdt2))));
+		_mm_storeu_ps(accelerationX + i, zero);
+		_mm_storeu_ps(accelerationY + i, zero);
+	}
+#endif
+	for (; i < count; ++i) {
+		const float vx = currentX[i] - previousX[i];
+		const float vy = currentY[i] - previousY[i];
+
+		previousX[i] = currentX[i];
+		previousY[i] = currentY[i];
+
+		currentX[i] += vx + accelerationX[i] * dt2;
+		currentY[i] += vy + accelerationY[i] * dt2;
+
+		accelerationX[i] = 0.f;
+		accelerationY[i] = 0.f;
+	}
+}
+
+// Largest squared distance any particle moved during the last step.
+VERLET_KERNEL inline float maxDisplacement2(const float* currentX,
+                                            const float* currentY,
+                                            const float* previousX,
+                                            const float* previousY,
+                                            int          count) {
+	float result = 0.f;
+
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	__m512 vmax = _mm512_setzero_ps();
+	for (; i + 16 <= count; i += 16) {
+		const __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(currentX + i),
+		                                _mm512_loadu_ps(previousX + i));
+		const __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(currentY + i),
+		                                _mm512_loadu_ps(previousY + i));
+		vmax            = _mm512_max_ps(
+		    vmax, _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+	}
+	alignas(64) float lanes[16];
+	_mm512_store_ps(lanes, vmax);
+	for (float lane : lanes) {
+		result = std::max(result, lane);
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	__m256 vmax = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(currentX + i),
+		                                _mm256_loadu_ps(previousX + i));
+		const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(currentY + i),
+		                                _mm256_loadu_ps(previousY + i));
+		vmax            = _mm256_max_ps(
+		    vmax, _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+	}
+	alignas(32) float lanes[8];
+	_mm256_store_ps(lanes, vmax);
+	for (float lane : lanes) {
+		result = std::max(result, lane);
+	}
+#elif defined(VERLET_SIMD_SSE)
+	__m128 vmax = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		const __m128 dx =
+		    _mm_sub_ps(_mm_loadu_ps(currentX + i), _mm_loadu_ps(previousX + i));
+		const __m128 dy =
+		    _mm_sub_ps(_mm_loadu_ps(currentY + i), _mm_loadu_ps(previousY + i));
+		vmax = _mm_max_ps(vmax,
+		                  _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, vmax);
+	for (float lane : lanes) {
+		result = std::max(result, lane);
+	}
+#endif
+	for (; i < count; ++i) {
+		const float dx = currentX[i] - previousX[i];
+		const float dy = currentY[i] - previousY[i];
+		result         = std::max(result, dx * dx + dy * dy);
+	}
+	return result;
+}
+
+// Multiplies the implicit velocity by `scale`, used when the step size
+// changes so that the particles keep their speed.
+VERLET_KERNEL inline void scaleVelocities(const float* currentX,
+                                          const float* currentY,
+                                          float*       previousX,
+                                          float*       previousY,
+                                          int          count,
+                                          float        scale) {
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	const __m512 vscale = _mm512_set1_ps(scale);
+	for (; i + 16 <= count; i += 16) {
+		const __m512 cx = _mm512_loadu_ps(currentX + i);
+		const __m512 cy = _mm512_loadu_ps(currentY + i);
+		const __m512 vx = _mm512_sub_ps(cx, _mm512_loadu_ps(previousX + i));
+		const __m512 vy = _mm512_sub_ps(cy, _mm512_loadu_ps(previousY + i));
+		_mm512_storeu_ps(previousX + i,
+		                 _mm512_sub_ps(cx, _mm512_mul_ps(vx, vscale)));
+		_mm512_storeu_ps(previousY + i,
+		                 _mm512_sub_ps(cy, _mm512_mul_ps(vy, vscale)));
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	const __m256 vscale = _mm256_set1_ps(scale);
+	for (; i + 8 <= count; i += 8) {
+		const __m256 cx = _mm256_loadu_ps(currentX + i);
+		const __m256 cy = _mm256_loadu_ps(currentY + i);
+		const __m256 vx = _mm256_sub_ps(cx, _mm256_loadu_ps(previousX + i));
+		const __m256 vy = _mm256_sub_ps(cy, _mm256_loadu_ps(previousY + i));
+		_mm256_storeu_ps(previousX + i,
+		                 _mm256_sub_ps(cx, _mm256_mul_ps(vx, vscale)));
+		_mm256_storeu_ps(previousY + i,
+		                 _mm256_sub_ps(cy, _mm256_mul_ps(vy, vscale)));
+	}
+#elif defined(VERLET_SIMD_SSE)
+	const __m128 vscale = _mm_set1_ps(scale);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 cx = _mm_loadu_ps(currentX + i);
+		const __m128 cy = _mm_loadu_ps(currentY + i);
+		const __m128 vx = _mm_sub_ps(cx, _mm_loadu_ps(previousX + i));
+		const __m128 vy = _mm_sub_ps(cy, _mm_loadu_ps(previousY + i));
+		_mm_storeu_ps(previousX + i, _mm_sub_ps(cx, _mm_mul_ps(vx, vscale)));
+		_mm_storeu_ps(previousY + i, _mm_sub_ps(cy, _mm_mul_ps(vy, vscale)));
+	}
+#endif
+	for (; i < count; ++i) {
+		previousX[i] = currentX[i] - (currentX[i] - previousX[i]) * scale;
+		previousY[i] = currentY[i] - (currentY[i] - previousY[i]) * scale;
+	}
+}
+
+// Keeps every particle inside the circle around `center`. Particles that are
+// already inside are left untouched, the vector paths blend the projected
+// position in only for the lanes that violate the constraint.
+VERLET_KERNEL inline void constrain(float*       currentX,
+                                    float*       currentY,
+                                    const float* radius,
+                                    int          count,
+                                    glm::vec2    center,
+                                    float        mapRadius) {
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	const __m512 cx = _mm512_set1_ps(center.x);
+	const __m512 cy = _mm512_set1_ps(center.y);
+	const __m512 mr = _mm512_set1_ps(mapRadius);
+	for (; i + 16 <= count; i += 16) {
+		const __m512    px    = _mm512_loadu_ps(currentX + i);
+		const __m512    py    = _mm512_loadu_ps(currentY + i);
+		const __m512    dx    = _mm512_sub_ps(px, cx);
+		const __m512    dy    = _mm512_sub_ps(py, cy);
+		const __m512    dist  = _mm512_sqrt_ps(
+		    _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)));
+		const __m512    limit = _mm512_sub_ps(mr, _mm512_loadu_ps(radius + i));
+		const __mmask16 mask  = _mm512_cmp_ps_mask(dist, limit, _CMP_GT_OQ);
+
+		const __m512 nx = _mm512_div_ps(dx, dist);
+		const __m512 ny = _mm512_div_ps(dy, dist);
+		const __m512 rx = _mm512_add_ps(cx, _mm512_mul_ps(nx, limit));
+		const __m512 ry = _mm512_add_ps(cy, _mm512_mul_ps(ny, limit));
+
+		_mm512_storeu_ps(currentX + i, _mm512_mask_blend_ps(mask, px, rx));
+		_mm512_storeu_ps(currentY + i, _mm512_mask_blend_ps(mask, py, ry));
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	const __m256 cx = _mm256_set1_ps(center.x);
+	const __m256 cy = _mm256_set1_ps(center.y);
+	const __m256 mr = _mm256_set1_ps(mapRadius);
+	for (; i + 8 <= count; i += 8) {
+		const __m256 px    = _mm256_loadu_ps(currentX + i);
+		const __m256 py    = _mm256_loadu_ps(currentY + i);
+		const __m256 dx    = _mm256_sub_ps(px, cx);
+		const __m256 dy    = _mm256_sub_ps(py, cy);
+		const __m256 dist  = _mm256_sqrt_ps(
+		    _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+		const __m256 limit = _mm256_sub_ps(mr, _mm256_loadu_ps(radius + i));
+		const __m256 mask  = _mm256_cmp_ps(dist, limit, _CMP_GT_OQ);
+
+		const __m256 nx = _mm256_div_ps(dx, dist);
+		const __m256 ny = _mm256_div_ps(dy, dist);
+		const __m256 rx = _mm256_add_ps(cx, _mm256_mul_ps(nx, limit));
+		const __m256 ry = _mm256_add_ps(cy, _mm256_mul_ps(ny, limit));
+
+		_mm256_storeu_ps(currentX + i, _mm256_blendv_ps(px, rx, mask));
+		_mm256_storeu_ps(currentY + i, _mm256_blendv_ps(py, ry, mask));
+	}
+#elif defined(VERLET_SIMD_SSE)
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 mr = _mm_set1_ps(mapRadius);
+	for (; i + 4 <= count; i += 4) {
+		const __m128 px    = _mm_loadu_ps(currentX + i);
+		const __m128 py    = _mm_loadu_ps(currentY + i);
+		const __m128 dx    = _mm_sub_ps(px, cx);
+		const __m128 dy    = _mm_sub_ps(py, cy);
+		const __m128 dist  = _mm_sqrt_ps(
+		    _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+		const __m128 limit = _mm_sub_ps(mr, _mm_loadu_ps(radius + i));
+		const __m128 mask  = _mm_cmpgt_ps(dist, limit);
+
+		const __m128 nx = _mm_div_ps(dx, dist);
+		const __m128 ny = _mm_div_ps(dy, dist);
+		const __m128 rx = _mm_add_ps(cx, _mm_mul_ps(nx, limit));
+		const __m128 ry = _mm_add_ps(cy, _mm_mul_ps(ny, limit));
+
+		_mm_storeu_ps(currentX + i, _mm_blendv_ps(px, rx, mask));
+		_mm_storeu_ps(currentY + i, _mm_blendv_ps(py, ry, mask));
+	}
+#endif
+	for (; i < count; ++i) {
+		const float dx    = currentX[i] - center.x;
+		const float dy    = currentY[i] - center.y;
+		const float dist  = std::sqrt(dx * dx + dy * dy);
+		const float limit = mapRadius - radius[i];
+		if (dist > limit) {
+			currentX[i] = center.x + dx / dist * limit;
+			currentY[i] = center.y + dy / dist * limit;
+		}
+	}
+}
+
+#if defined(VERLET_SIMD_AVX512)
+// Without optimization GCC implements the gather as a macro that passes the
+// mask on as a signed short, which -Wsign-conversion reports at the caller.
+// The conversion happens inside the macro, so no cast at the call reaches it.
+#	if defined(__GNUC__) && !defined(__clang__)
+#		pragma GCC diagnostic push
+#		pragma GCC diagnostic ignored "-Wsign-conversion"
+#	endif
+VERLET_KERNEL inline __m512 gatherLanes(const float* base,
+                                        __mmask16    lanes,
+                                        __m512i      idx) {
+	return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), lanes, idx, base, 4);
+}
+#	if defined(__GNUC__) && !defined(__clang__)
+#		pragma GCC diagnostic pop
+#	endif
+#endif
+
+// Resolves overlaps between object `id` and a batch of distinct candidates.
+// Every correction in the batch is computed from the same position of `id`,
+// which is moved by their sum once the batch is done. Returns the number of
+// candidates that were actually overlapping.
+//
+// Batches are usually shorter than a 16-wide vector, so the AVX-512 path
+// covers the remainder with a masked iteration instead of the scalar loop.
+VERLET_KERNEL inline int solveContacts(float*       currentX,
+                                       float*       currentY,
+                                       const float* radius,
+                                       int          id,
+                                       const int*   others,
+                                       int          count) {
+	const float ax = currentX[id];
+	const float ay = currentY[id];
+	const float ar = radius[id];
+
+	float sumX        = 0.f;
+	float sumY        = 0.f;
+	int   numContacts = 0;
+
+	int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+	const __m512 vax  = _mm512_set1_ps(ax);
+	const __m512 vay  = _mm512_set1_ps(ay);
+	const __m512 var  = _mm512_set1_ps(ar);
+	const __m512 half = _mm512_set1_ps(0.5f);
+	const __m512 zero = _mm512_setzero_ps();
+
+	__m512 accX = zero;
+	__m512 accY = zero;
+	for (; i < count; i += 16) {
+		const __mmask16 lanes =
+		    count - i >= 16
+		        ? static_cast<__mmask16>(0xffff)
+		        : static_cast<__mmask16>((1u << (count - i)) - 1u);
+		const __m512i idx = _mm512_maskz_loadu_epi32(lanes, others + i);
+		const __m512  dx =
+		    _mm512_sub_ps(vax, gatherLanes(currentX, lanes, idx));
+		const __m512 dy =
+		    _mm512_sub_ps(vay, gatherLanes(currentY, lanes, idx));
+		const __m512 minDist =
+		    _mm512_add_ps(var, gatherLanes(radius, lanes, idx));
+		const __m512 dist2 =
+		    _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+		const __mmask16 mask = _mm512_mask_cmp_ps_mask(
+		    _mm512_mask_cmp_ps_mask(lanes, dist2, zero, _CMP_GT_OQ),
+		    dist2,
+		    _mm512_mul_ps(minDist, minDist),
+		    _CMP_LT_OQ);
+
+		unsigned bits = static_cast<unsigned>(mask);
+		if (bits == 0) continue;
+
+		const __m512 dist  = _mm512_sqrt_ps(dist2);
+		const __m512 scale = _mm512_maskz_div_ps(
+		    mask, _mm512_mul_ps(half, _mm512_sub_ps(minDist, dist)), dist);
+		const __m512 cx = _mm512_mul_ps(dx, scale);
+		const __m512 cy = _mm512_mul_ps(dy, scale);
+		accX            = _mm512_add_ps(accX, cx);
+		accY            = _mm512_add_ps(accY, cy);
+
+		alignas(64) float correctionX[16];
+		alignas(64) float correctionY[16];
+		_mm512_store_ps(correctionX, cx);
+		_mm512_store_ps(correctionY, cy);
+
+		numContacts += std::popcount(bits);
+		for (; bits != 0; bits &= bits - 1) {
+			const int lane  = std::countr_zero(bits);
+			const int other = others[i + lane];
+			currentX[other] -= correctionX[lane];
+			currentY[other] -= correctionY[lane];
+		}
+	}
+
+	alignas(64) float laneX[16];
+	alignas(64) float laneY[16];
+	_mm512_store_ps(laneX, accX);
+	_mm512_store_ps(laneY, accY);
+	for (int lane = 0; lane < 16; ++lane) {
+		sumX += laneX[lane];
+		sumY += laneY[lane];
+	}
+#elif defined(VERLET_SIMD_AVX2)
+	const __m256 vax  = _mm256_set1_ps(ax);
+	const __m256 vay  = _mm256_set1_ps(ay);
+	const __m256 var  = _mm256_set1_ps(ar);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 accX = zero;
+	__m256 accY = zero;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i idx =
+		    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(others + i));
+		const __m256 dx =
+		    _mm256_sub_ps(vax, _mm256_i32gather_ps(currentX, idx, 4));
+		const __m256 dy =
+		    _mm256_sub_ps(vay, _mm256_i32gather_ps(currentY, idx, 4));
+		const __m256 minDist =
+		    _mm256_add_ps(var, _mm256_i32gather_ps(radius, idx, 4));
+		const __m256 dist2 =
+		    _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		const __m256 mask = _mm256_and_ps(
+		    _mm256_cmp_ps(dist2, _mm256_mul_ps(minDist, minDist), _CMP_LT_OQ),
+		    _mm256_cmp_ps(dist2, zero, _CMP_GT_OQ));
+
+		unsigned bits = static_cast<unsigned>(_mm256_movemask_ps(mask));
+		if (bits == 0) continue;
+
+		const __m256 dist  = _mm256_sqrt_ps(dist2);
+		const __m256 scale = _mm256_and_ps(
+		    mask,
+		    _mm256_div_ps(_mm256_mul_ps(half, _mm256_sub_ps(minDist, dist)),
+		                  dist));
+		const __m256 cx = _mm256_mul_ps(dx, scale);
+		const __m256 cy = _mm256_mul_ps(dy, scale);
+		accX            = _mm256_add_ps(accX, cx);
+		accY            = _mm256_add_ps(accY, cy);
+
+		alignas(32) float correctionX[8];
+		alignas(32) float correctionY[8];
+		_mm256_store_ps(correctionX, cx);
+		_mm256_store_ps(correctionY, cy);
+
+		numContacts += std::popcount(bits);
+		for (; bits != 0; bits &= bits - 1) {
+			const int lane  = std::countr_zero(bits);
+			const int other = others[i + lane];
+			currentX[other] -= correctionX[lane];
+			currentY[other] -= correctionY[lane];
+		}
+	}
+
+	alignas(32) float laneX[8];
+	alignas(32) float laneY[8];
+	_mm256_store_ps(laneX, accX);
+	_mm256_store_ps(laneY, accY);
+	for (int lane = 0; lane < 8; ++lane) {
+		sumX += laneX[lane];
+		sumY += laneY[lane];
+	}
+#endif
+	for (; i < count; ++i) {
+		const int   other   = others[i];
+		const float dx      = ax - currentX[other];
+		const float dy      = ay - currentY[other];
+		const float minDist = ar + radius[other];
+		const float dist2   = dx * dx + dy * dy;
+		if (dist2 > 0.f && dist2 < minDist * minDist) {
+			const float dist  = std::sqrt(dist2);
+			const float scale = 0.5f * (minDist - dist) / dist;
+			sumX += dx * scale;
+			sumY += dy * scale;
+			currentX[other] -= dx * scale;
+			currentY[other] -= dy * scale;
+			++numContacts;
+		}
+	}
+
+	currentX[id] += sumX;
+	currentY[id] += sumY;
+
+	return numContacts;
+}
+
+// Merges the signed distance to every circle into the field `values` at the
+// given points, with a polynomial smooth minimum of width `k`. Circles are
+// the outer loop, so the points of a short batch stay in cache and every
+// lane of the vector paths updates an independent point.
+VERLET_KERNEL inline void smoothUnion(float*       values,
+                                      const float* pointX,
+                                      const float* pointY,
+                                      int          count,
+                                      const float* circleX,
+                                      const float* circleY,
+                                      const float* circleRadius,
+                                      int          numCircles,
+                                      float        k) {
+	for (int c = 0; c < numCircles; ++c) {
+		int i = 0;
+#if defined(VERLET_SIMD_AVX512)
+		const __m512 cx      = _mm512_set1_ps(circleX[c]);
+		const __m512 cy      = _mm512_set1_ps(circleY[c]);
+		const __m512 cr      = _mm512_set1_ps(circleRadius[c]);
+		const __m512 vk      = _mm512_set1_ps(k);
+		const __m512 quarter = _mm512_set1_ps(1.f / 4.f);
+		const __m512 zero    = _mm512_setzero_ps();
+		for (; i + 16 <= count; i += 16) {
+			const __m512 v     = _mm512_loadu_ps(values + i);
+			const __m512 dx    = _mm512_sub_ps(cx, _mm512_loadu_ps(pointX + i));
+			const __m512 dy    = _mm512_sub_ps(cy, _mm512_loadu_ps(pointY + i));
+			const __m512 dist2 =
+			    _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+			const __m512 d     = _mm512_sub_ps(_mm512_sqrt_ps(dist2), cr);
+			const __m512 gap   = _mm512_abs_ps(_mm512_sub_ps(d, v));
+			const __m512 h     =
+			    _mm512_div_ps(_mm512_max_ps(_mm512_sub_ps(vk, gap), zero), vk);
+			const __m512 blend =
+			    _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(h, h), vk), quarter);
+			_mm512_storeu_ps(values + i,
+			                 _mm512_sub_ps(_mm512_min_ps(d, v), blend));
+		}
+#elif defined(VERLET_SIMD_AVX2)
+		const __m256 cx      = _mm256_set1_ps(circleX[c]);
+		const __m256 cy      = _mm256_set1_ps(circleY[c]);
+		const __m256 cr      = _mm256_set1_ps(circleRadius[c]);
+		const __m256 vk      = _mm256_set1_ps(k);
+		const __m256 quarter = _mm256_set1_ps(1.f / 4.f);
+		const __m256 zero    = _mm256_setzero_ps();
+		const __m256 sign    = _mm256_set1_ps(-0.f);
+		for (; i + 8 <= count; i += 8) {
+			const __m256 v     = _mm256_loadu_ps(values + i);
+			const __m256 dx    = _mm256_sub_ps(cx, _mm256_loadu_ps(pointX + i));
+			const __m256 dy    = _mm256_sub_ps(cy, _mm256_loadu_ps(pointY + i));
+			const __m256 dist2 =
+			    _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			const __m256 d     = _mm256_sub_ps(_mm256_sqrt_ps(dist2), cr);
+			const __m256 gap   = _mm256_andnot_ps(sign, _mm256_sub_ps(d, v));
+			const __m256 h     =
+			    _mm256_div_ps(_mm256_max_ps(_mm256_sub_ps(vk, gap), zero), vk);
+			const __m256 blend =
+			    _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(h, h), vk), quarter);
+			_mm256_storeu_ps(values + i,
+			                 _mm256_sub_ps(_mm256_min_ps(d, v), blend));
+		}
+#elif defined(VERLET_SIMD_SSE)
+		const __m128 cx      = _mm_set1_ps(circleX[c]);
+		const __m128 cy      = _mm_set1_ps(circleY[c]);
+		const __m128 cr      = _mm_set1_ps(circleRadius[c]);
+		const __m128 vk      = _mm_set1_ps(k);
+		const __m128 quarter = _mm_set1_ps(1.f / 4.f);
+		const __m128 zero    = _mm_setzero_ps();
+		const __m128 sign    = _mm_set1_ps(-0.f);
+		for (; i + 4 <= count; i += 4) {
+			const __m128 v     = _mm_loadu_ps(values + i);
+			const __m128 dx    = _mm_sub_ps(cx, _mm_loadu_ps(pointX + i));
+			const __m128 dy    = _mm_sub_ps(cy, _mm_loadu_ps(pointY + i));
+			const __m128 dist2 =
+			    _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			const __m128 d     = _mm_sub_ps(_mm_sqrt_ps(dist2), cr);
+			const __m128 gap   = _mm_andnot_ps(sign, _mm_sub_ps(d, v));
+			const __m128 h     =
+			    _mm_div_ps(_mm_max_ps(_mm_sub_ps(vk, gap), zero), vk);
+			const __m128 blend =
+			    _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(h, h), vk), quarter);
+			_mm_storeu_ps(values + i, _mm_sub_ps(_mm_min_ps(d, v), blend));
+		}
+#endif
+		for (; i < count; ++i) {
+			const float dx = circleX[c] - pointX[i];
+			const float dy = circleY[c] - pointY[i];
+			const float d  = std::sqrt(dx * dx + dy * dy) - circleRadius[c];
+			const float h  = std::max(k - std::abs(d - values[i]), 0.f) / k;
+			values[i] = std::min(d, values[i]) - h * h * k * (1.f / 4.f);
+		}
+	}
+}
+
+inline const Kernels table = {
+    .isa              = VERLET_KERNELS_ISA,
+    .accelerate       = accelerate,
+    .integrate        = integrate,
+    .maxDisplacement2 = maxDisplacement2,
+    .scaleVelocities  = scaleVelocities,
+    .constrain        = constrain,
+    .solveContacts    = solveContacts,
+    .smoothUnion      = smoothUnion,
+};
+
+}  // namespace VERLET_KERNELS_NAMESPACE
+
+#undef VERLET_KERNELS_NAMESPACE
+#undef VERLET_KERNELS_ISA
+#undef VERLET_KERNEL
+#undef VERLET_SIMD_AVX512
+#undef VERLET_SIMD_AVX2
+#undef VERLET_SIMD_SSE
@@ -1,11 +1,16 @@
 #include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
 
 #include <dubu_opengl_app/dubu_opengl_app.hpp>
 #include <glm/glm.hpp>
 #include <imgui/imgui.h>
 
 #include "marching_squares.hpp"
+#include "simulation_thread.hpp"
 #include "solver.hpp"
+#include "task_graph.hpp"
 
 class App : public dubu::opengl_app::AppBase {
 public:
@@ -14,30 +19,52 @@ public:
 	virtual ~App() = default;
 
 protected:
-	virtual void Init() override { solver.addObject(); }
+	virtual void Init() override {
+		Solver& solver = simulation.getSolver();
+		solver.addObject();
+		solverSettings = solver.getSettings();
+		simulation.start();
+
+		// The contour of the newest snapshot is extracted while the UI of the
+		// frame is built
+		const int field =
+		    frameGraph.addNode([this] { marchingSquares.evaluate(); });
+		frameGraph.addNode([this] { marchingSquares.buildMesh(); }, {field});
+	}
 
 	virtual void Update() override {
-		static float t           = 0.f;
-		static float dt          = 1.f / 60.f;
-		static float accumulator = 0.f;
-
-		static float currentTime = static_cast<float>(glfwGetTime());
-
-		const float newTime   = static_cast<float>(glfwGetTime());
-		const float frameTime = std::min(newTime - currentTime, 0.25f);
-		currentTime           = newTime;
-
-		accumulator += frameTime;
-
-		while (accumulator >= dt) {
-			solver.update(dt);
-			accumulator -= dt;
-		}
+		// The simulation is a step ahead of the display, the contour is built
+		// in between the last two steps
+		const SolverSnapshot& snapshot = simulation.getSnapshot();
+		captureFrame(snapshot,
+		             settings.interpolate
+		                 ? snapshot.getBlend(SolverSnapshot::Clock::now())
+		                 : 1.f);
+		frameGraph.launch();
+
+		// The workers are only replaced once the frame graph has completed
+		TaskScheduler& scheduler   = getTaskScheduler();
+		int            numThreads  = scheduler.getNumThreads();
+		bool           pinThreads  = scheduler.getPinThreads();
+		bool           reconfigure = false;
 
 		ImGui::DockSpaceOverViewport();
 
 		if (ImGui::Begin("Settings")) {
 			ImGui::DragFloat("zoom", &settings.zoom);
+
+			reconfigure |= ImGui::DragInt("Threads",
+			                              &numThreads,
+			                              0.1f,
+			                              1,
+			                              TaskScheduler::getHardwareThreads());
+			reconfigure |= ImGui::Checkbox("Pin Threads", &pinThreads);
+
+			if (ImGui::DragInt("Sim Rate", &settings.stepRate, 1.f, 10, 240)) {
+				settings.stepRate = std::clamp(settings.stepRate, 10, 240);
+				stepRateChanged   = true;
+			}
+			ImGui::Checkbox("Interpolate", &settings.interpolate);
 		}
 		ImGui::End();
 
@@ -86,7 +113,7 @@ protected:
 			                                 io.MousePos.y - origin.y);
 
 			if (is_hovered && ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
-				solver.addObject();
+				simulation.send({SolverCommand::Type::Spawn});
 			}
 
 			// Pan (we use a zero mouse threshold when there's no context menu)
@@ -107,7 +134,7 @@ protected:
 				ImGui::OpenPopupOnItemClick("context");
 			if (ImGui::BeginPopup("context")) {
 				if (ImGui::MenuItem("Remove all", NULL, false)) {
-					solver.clear();
+					clearRequested = true;
 				}
 				ImGui::EndPopup();
 			}
@@ -128,38 +155,109 @@ protected:
 			glm::mat3   A(
                 zoom, 0.f, 0.f, 0.f, zoom, 0.f, origin.x, origin.y, 1.f);
 
-			const float mapRadius = solver.getMapRadius();
-			draw_list->AddCircle(
-			    {origin.x, origin.y}, mapRadius * zoom, 0xff666666);
-
-			marchingSquares.newFrame();
-
-			solver.apply([&](const VerletObject& o) {
-				marchingSquares.addCircle(o.currentPosition, o.radius);
-			});
+			if (solverSettings.useContainer) {
+				const float mapRadius = solverSettings.mapRadius;
+				draw_list->AddCircle(
+				    {origin.x, origin.y}, mapRadius * zoom, 0xff666666);
+			}
 
+			frameGraph.wait();
 			marchingSquares.draw(draw_list, A);
 
 			ImGui::EndChild();
 		}
 		ImGui::End();
 
-		solver.debug();
+		frameGraph.wait();
+		if (reconfigure) {
+			simulation.stop();
+			scheduler.configure(std::max(1, numThreads), pinThreads);
+			simulation.start();
+		}
+
+		const auto input = Solver::debug(solverSettings, snapshot.stats);
+		settingsChanged |= input.settingsChanged;
+		wakeAllRequested |= input.wakeAll;
+
+		// Commands are sent again next frame if the queue is full
+		if (stepRateChanged) {
+			const float stepTime = 1.f / static_cast<float>(settings.stepRate);
+			stepRateChanged      = !simulation.send(
+			    {.type     = SolverCommand::Type::SetStepTime,
+			     .stepTime = stepTime});
+		}
+		if (clearRequested) {
+			clearRequested = !simulation.send({SolverCommand::Type::Clear});
+		}
+		if (settingsChanged) {
+			settingsChanged = !simulation.send(
+			    {SolverCommand::Type::SetSettings, solverSettings});
+		}
+		if (wakeAllRequested) {
+			wakeAllRequested = !simulation.send({SolverCommand::Type::WakeAll});
+		}
 		marchingSquares.debug();
 
 		ImGui::ShowMetricsWindow();
 	}
 
 private:
-	Solver          solver;
-	MarchingSquares marchingSquares;
+	// Copies the particles into the contour input of the frame, `blend` of
+	// the way from their previous to their current positions.
+	void captureFrame(const SolverSnapshot& snapshot, float blend) {
+		marchingSquares.newFrame();
+		for (int i = 0; i < static_cast<int>(snapshot.position.size()); ++i) {
+			marchingSquares.addCircle(
+			    glm::mix(snapshot.previous[i], snapshot.position[i], blend),
+			    snapshot.radius[i]);
+		}
+	}
+
+	SimulationThread simulation;
+	Solver::Settings solverSettings   = {};
+	bool             settingsChanged  = false;
+	bool             stepRateChanged  = false;
+	bool             clearRequested   = false;
+	bool             wakeAllRequested = false;
+	MarchingSquares  marchingSquares;
+	TaskGraph        frameGraph{getTaskScheduler()};
 
 	struct {
-		float zoom = 1.f;
+		float zoom        = 1.f;
+		int   stepRate    = 60;
+		bool  interpolate = true;
 	} settings;
 };
 
-int main() {
+int main(int argc, char** argv) {
+	// --isa=<scalar|sse4.2|avx2|avx512> forces a kernel path for testing,
+	// --threads=<n> and --pin-threads set up the task scheduler
+	int  numThreads = 0;
+	bool pinThreads = false;
+	for (int i = 1; i < argc; ++i) {
+		const std::string_view arg = argv[i];
+		if (arg.starts_with("--threads=")) {
+			numThreads = std::atoi(argv[i] + 10);
+			continue;
+		}
+		if (arg == "--pin-threads") {
+			pinThreads = true;
+			continue;
+		}
+		if (!arg.starts_with("--isa=")) continue;
+
+		const auto isa = parseIsa(arg.substr(6));
+		if (!isa || !selectIsa(*isa)) {
+			std::fprintf(stderr,
+			             "Instruction set '%s' is not available, using %s\n",
+			             argv[i] + 6,
+			             getSimdName());
+		}
+	}
+	if (numThreads > 0 || pinThreads) {
+		getTaskScheduler().configure(numThreads, pinThreads);
+	}
+
 	App app;
 
 	app.Run();
@@ -1,52 +1,74 @@
 #pragma once
 
+#include <algorithm>
+#include <initializer_list>
+#include <limits>
 #include <tuple>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <imgui/imgui.h>
 
-struct Circle {
-	glm::vec2 pos;
-	float     radius;
-};
+#include "kernels.hpp"
+#include "task_scheduler.hpp"
+
 class MarchingSquares {
 public:
-	MarchingSquares() { points.resize((Width + 1) * (Height + 1), 0.f); }
+	MarchingSquares() {
+		points.resize(Stride * (Height + 1), 0.f);
+		pointX.resize(points.size());
+		pointY.resize(points.size());
+		for (int i = 0; i < static_cast<int>(points.size()); ++i) {
+			pointX[i] =
+			    static_cast<float>((i % Stride - Width / 2) * CellSize);
+			pointY[i] =
+			    static_cast<float>((i / Stride - Height / 2) * CellSize);
+		}
+	}
 	void newFrame() {
-		circles.clear();
+		circleX.clear();
+		circleY.clear();
+		circleRadius.clear();
 		for (auto& p : points) {
 			p = std::numeric_limits<float>::infinity();
 		}
 	}
 	void addCircle(glm::vec2 pos, float radius) {
-		circles.push_back({pos, std::max(radius, 1.f * CellSize)});
+		circleX.push_back(pos.x);
+		circleY.push_back(pos.y);
+		circleRadius.push_back(std::max(radius, 1.f * CellSize));
 	}
 
-	const float smin(float a, float b, float k) {
-		const float h = std::max(k - std::abs(a - b), 0.f) / k;
-		return std::min(a, b) - h * h * k * (1.f / 4.f);
+	// Evaluates the field at every grid point, chunks of points are blended
+	// with all circles by the field kernel and are a multiple of every vector
+	// width
+	void evaluate() {
+		const int count     = static_cast<int>(points.size());
+		const int numChunks = (count + FieldChunk - 1) / FieldChunk;
+		getTaskScheduler().parallelFor(0, numChunks, 1, [&](int c) {
+			const int begin = c * FieldChunk;
+			smoothUnion(points.data() + begin,
+			            pointX.data() + begin,
+			            pointY.data() + begin,
+			            std::min(FieldChunk, count - begin),
+			            circleX.data(),
+			            circleY.data(),
+			            circleRadius.data(),
+			            static_cast<int>(circleX.size()),
+			            smoothness);
+		});
 	}
 
-	void draw(ImDrawList* draw_list, const glm::mat3& A) {
-#pragma omp parallel for
-		for (int i = 0; i < points.size(); ++i) {
-			const auto x  = i % Stride;
-			const auto y  = i / Stride;
-
-			const auto pp = glm::vec2((x - Width / 2) * CellSize,
-			                          (y - Height / 2) * CellSize);
-			const auto p0 = A * glm::vec3(pp, 1.f);
-
-			for (auto [cp, r] : circles) {
-				points[x + y * (Width + 1)] = smin(glm::distance(cp, pp) - r,
-				                                   points[x + y * (Width + 1)],
-				                                   smoothness);
-			}
-		}
+	// Extracts the contour polygons of the field in world space, so they can
+	// be built before the view transform of the frame is known.
+	void buildMesh() {
+		polyStart.assign(1, 0);
+		polyVertices.clear();
+		const auto addPoly = [&](std::initializer_list<glm::vec2> verts) {
+			polyVertices.insert(polyVertices.end(), verts);
+			polyStart.push_back(static_cast<int>(polyVertices.size()));
+		};
 
-		std::vector<std::pair<glm::vec3, glm::vec3>> lines;
-		std::vector<std::vector<glm::vec3>>          polys;
 		for (int y = 0; y < Height; ++y) {
 			for (int x = 0; x < Width; ++x) {
 				static constexpr float Threshold = 0.f;
@@ -61,18 +83,14 @@ public:
 				if (v2 <= Threshold) mask |= 0x4;
 				if (v3 <= Threshold) mask |= 0x8;
 
-				const auto p0 = A * glm::vec3((x - Width / 2) * CellSize,
-				                              (y - Height / 2) * CellSize,
-				                              1.f);
-				const auto p2 = A * glm::vec3((x + 1 - Width / 2) * CellSize,
-				                              (y - Height / 2) * CellSize,
-				                              1.f);
-				const auto p6 = A * glm::vec3((x - Width / 2) * CellSize,
-				                              (y + 1 - Height / 2) * CellSize,
-				                              1.f);
-				const auto p8 = A * glm::vec3((x + 1 - Width / 2) * CellSize,
-				                              (y + 1 - Height / 2) * CellSize,
-				                              1.f);
+				const glm::vec2 p0((x - Width / 2) * CellSize,
+				                   (y - Height / 2) * CellSize);
+				const glm::vec2 p2((x + 1 - Width / 2) * CellSize,
+				                   (y - Height / 2) * CellSize);
+				const glm::vec2 p6((x - Width / 2) * CellSize,
+				                   (y + 1 - Height / 2) * CellSize);
+				const glm::vec2 p8((x + 1 - Width / 2) * CellSize,
+				                   (y + 1 - Height / 2) * CellSize);
 
 				const auto p1 = glm::mix(p0, p2, (Threshold - v0) / (v1 - v0));
 				const auto p3 = glm::mix(p0, p6, (Threshold - v0) / (v3 - v0));
@@ -83,67 +101,65 @@ public:
 
 				switch (mask) {
 				case 0b1111:
-					polys.push_back({p0, p2, p8, p6});
+					addPoly({p0, p2, p8, p6});
 					break;
 				case 0b0001:
-					polys.push_back({p0, p1, p3});
+					addPoly({p0, p1, p3});
 					break;
 				case 0b0010:
-					polys.push_back({p1, p2, p5});
+					addPoly({p1, p2, p5});
 					break;
 				case 0b0100:
-					polys.push_back({p5, p8, p7});
+					addPoly({p5, p8, p7});
 					break;
 				case 0b1000:
-					polys.push_back({p3, p7, p6});
+					addPoly({p3, p7, p6});
 					break;
 				case 0b0011:
-					polys.push_back({p0, p2, p5, p3});
+					addPoly({p0, p2, p5, p3});
 					break;
 				case 0b1100:
-					polys.push_back({p3, p5, p8, p6});
+					addPoly({p3, p5, p8, p6});
 					break;
 				case 0b0110:
-					polys.push_back({p1, p2, p8, p7});
+					addPoly({p1, p2, p8, p7});
 					break;
 				case 0b1001:
-					polys.push_back({p0, p1, p7, p6});
+					addPoly({p0, p1, p7, p6});
 					break;
 
 				case 0b0111:
-					polys.push_back({p0, p2, p8, p7, p3});
+					addPoly({p0, p2, p8, p7, p3});
 					break;
 				case 0b1110:
-					polys.push_back({p1, p2, p8, p6, p3});
+					addPoly({p1, p2, p8, p6, p3});
 					break;
 				case 0b1101:
-					polys.push_back({p0, p1, p5, p8, p6});
+					addPoly({p0, p1, p5, p8, p6});
 					break;
 				case 0b1011:
-					polys.push_back({p0, p2, p5, p7, p6});
+					addPoly({p0, p2, p5, p7, p6});
 					break;
 
 				case 0b0101:
-					polys.push_back({p0, p1, p5, p8, p7, p3});
+					addPoly({p0, p1, p5, p8, p7, p3});
 					break;
 				case 0b1010:
-					polys.push_back({p1, p2, p5, p7, p6, p3});
+					addPoly({p1, p2, p5, p7, p6, p3});
 					break;
 				}
 			}
 		}
+	}
 
-		for (auto& [start, end] : lines) {
-			draw_list->AddLine(ImVec2(start.x, start.y),
-			                   ImVec2(end.x, end.y),
-			                   0xffffff66,
-			                   1.f);
-		}
+	void draw(ImDrawList* draw_list, const glm::mat3& A) const {
 		std::vector<ImVec2> pts;
-		for (auto& verts : polys) {
+		for (int poly = 0; poly + 1 < static_cast<int>(polyStart.size());
+		     ++poly) {
 			pts.clear();
-			for (int i = 0; i < verts.size(); ++i) {
-				pts.emplace_back(verts[i].x, verts[i].y);
+			for (int i = polyStart[poly]; i < polyStart[poly + 1]; ++i) {
+				const auto p = A * glm::vec3(polyVertices[i], 1.f);
+				pts.emplace_back(p.x, p.y);
 			}
 			draw_list->AddConvexPolyFilled(
 			    pts.data(), static_cast<int>(pts.size()), 0xffffff66);
@@ -160,13 +176,21 @@ public:
 	}
 
 private:
-	std::vector<Circle> circles;
-	std::vector<float>  points;
-
-	static constexpr int CellSize = 10;
-	static constexpr int Width    = 100;
-	static constexpr int Height   = 100;
-	static constexpr int Stride   = Width + 1;
+	std::vector<float> circleX;
+	std::vector<float> circleY;
+	std::vector<float> circleRadius;
+	std::vector<float> points;
+	std::vector<float> pointX;
+	std::vector<float> pointY;
+
+	std::vector<glm::vec2> polyVertices;
+	std::vector<int>       polyStart = {0};
+
+	static constexpr int CellSize   = 10;
+	static constexpr int Width      = 100;
+	static constexpr int Height     = 100;
+	static constexpr int Stride     = Width + 1;
+	static constexpr int FieldChunk = 256;
 
 	float smoothness = 50.f;
 };
\ No newline at end of file
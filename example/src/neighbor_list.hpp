@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "particles.hpp"
+#include "task_scheduler.hpp"
+
+// Decides when Verlet neighbor lists have to be rebuilt. The lists hold every
+// pair closer than the sum of their radii plus `skin`, which stays a superset
+// of the colliding pairs until some particle has moved more than half the
+// skin since the lists were built.
+struct NeighborList {
+	std::vector<float> referenceX;
+	std::vector<float> referenceY;
+	float              skin  = 0.f;
+	bool               valid = false;
+
+	void invalidate() { valid = false; }
+
+	bool needsRebuild(const Particles& particles, float wantedSkin) const {
+		if (!valid || skin != wantedSkin ||
+		    static_cast<int>(referenceX.size()) != particles.size()) {
+			return true;
+		}
+
+		const int   count      = particles.size();
+		const float threshold2 = 0.25f * skin * skin;
+
+		const int moved = getTaskScheduler().parallelSum(0, count, [&](int i) {
+			const float dx = particles.currentX[i] - referenceX[i];
+			const float dy = particles.currentY[i] - referenceY[i];
+			return dx * dx + dy * dy > threshold2 ? 1 : 0;
+		});
+		return moved > 0;
+	}
+
+	// Records the positions the lists were just built from.
+	void update(const Particles& particles, float builtSkin) {
+		skin = builtSkin;
+		referenceX.assign(particles.currentX.begin(), particles.currentX.end());
+		referenceY.assign(particles.currentY.begin(), particles.currentY.end());
+		valid = true;
+	}
+};
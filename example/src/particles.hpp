@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "task_scheduler.hpp"
+
+struct VerletObject {
+	glm::vec2 currentPosition  = {};
+	glm::vec2 previousPosition = {};
+	glm::vec2 acceleration     = {};
+	float     radius           = 5.f;
+	uint32_t  color            = 0xffffffff;
+};
+
+// Structure-of-arrays particle storage. The hot solver loops only touch the
+// position, acceleration and radius arrays, color is kept apart as cold data.
+struct Particles {
+	std::vector<float>    currentX;
+	std::vector<float>    currentY;
+	std::vector<float>    previousX;
+	std::vector<float>    previousY;
+	std::vector<float>    accelerationX;
+	std::vector<float>    accelerationY;
+	std::vector<float>    radius;
+	std::vector<uint32_t> color;
+
+	// Where the particle was before the last update, rendering blends from
+	// there to the current position.
+	std::vector<float> stepStartX;
+	std::vector<float> stepStartY;
+
+	// Number of frames the particle has been at rest.
+	std::vector<int> restFrames;
+
+	// Sleeping particles with the same value fell asleep as one island.
+	std::vector<int> island;
+
+	int size() const { return static_cast<int>(radius.size()); }
+
+	void add(const VerletObject& o) {
+		currentX.push_back(o.currentPosition.x);
+		currentY.push_back(o.currentPosition.y);
+		previousX.push_back(o.previousPosition.x);
+		previousY.push_back(o.previousPosition.y);
+		accelerationX.push_back(o.acceleration.x);
+		accelerationY.push_back(o.acceleration.y);
+		radius.push_back(o.radius);
+		color.push_back(o.color);
+		stepStartX.push_back(o.currentPosition.x);
+		stepStartY.push_back(o.currentPosition.y);
+		restFrames.push_back(0);
+		island.push_back(0);
+	}
+
+	void clear() {
+		currentX.clear();
+		currentY.clear();
+		previousX.clear();
+		previousY.clear();
+		accelerationX.clear();
+		accelerationY.clear();
+		radius.clear();
+		color.clear();
+		stepStartX.clear();
+		stepStartY.clear();
+		restFrames.clear();
+		island.clear();
+	}
+
+	// Moves the particle in slot order[i] to slot i for every array.
+	void permute(const std::vector<int>& order) {
+		gather(currentX, order, floatScratch);
+		gather(currentY, order, floatScratch);
+		gather(previousX, order, floatScratch);
+		gather(previousY, order, floatScratch);
+		gather(accelerationX, order, floatScratch);
+		gather(accelerationY, order, floatScratch);
+		gather(radius, order, floatScratch);
+		gather(color, order, colorScratch);
+		gather(stepStartX, order, floatScratch);
+		gather(stepStartY, order, floatScratch);
+		gather(restFrames, order, intScratch);
+		gather(island, order, intScratch);
+	}
+
+	void swap(int a, int b) {
+		std::swap(currentX[a], currentX[b]);
+		std::swap(currentY[a], currentY[b]);
+		std::swap(previousX[a], previousX[b]);
+		std::swap(previousY[a], previousY[b]);
+		std::swap(accelerationX[a], accelerationX[b]);
+		std::swap(accelerationY[a], accelerationY[b]);
+		std::swap(radius[a], radius[b]);
+		std::swap(color[a], color[b]);
+		std::swap(stepStartX[a], stepStartX[b]);
+		std::swap(stepStartY[a], stepStartY[b]);
+		std::swap(restFrames[a], restFrames[b]);
+		std::swap(island[a], island[b]);
+	}
+
+	glm::vec2 getPosition(int i) const { return {currentX[i], currentY[i]}; }
+
+	glm::vec2 getStepStart(int i) const {
+		return {stepStartX[i], stepStartY[i]};
+	}
+
+	void setPosition(int i, glm::vec2 p) {
+		currentX[i] = p.x;
+		currentY[i] = p.y;
+	}
+
+private:
+	template <typename T>
+	static void gather(std::vector<T>&         values,
+	                   const std::vector<int>& order,
+	                   std::vector<T>&         scratch) {
+		const int count = static_cast<int>(order.size());
+		scratch.resize(count);
+		getTaskScheduler().parallelFor(0, count, [&](int i) {
+			scratch[i] = values[order[i]];
+		});
+		values.swap(scratch);
+	}
+
+	std::vector<float>    floatScratch;
+	std::vector<uint32_t> colorScratch;
+	std::vector<int>      intScratch;
+};
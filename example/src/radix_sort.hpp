@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "task_scheduler.hpp"
+
+inline uint32_t spreadBits(uint32_t v) {
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+inline uint32_t mortonCode(uint32_t x, uint32_t y) {
+	return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// Parallel LSD radix sort of 32-bit keys with an attached int payload. The
+// input is split into a fixed number of blocks, each block histograms and
+// scatters its own elements, so the result is stable and independent of the
+// number of threads. Scratch storage is kept between calls.
+class RadixSort {
+	static constexpr int RadixBits = 8;
+	static constexpr int Buckets   = 1 << RadixBits;
+	static constexpr int MaxBlocks = 64;
+	static constexpr int MinBlock  = 4096;
+
+public:
+	void sort(std::vector<uint32_t>& keys, std::vector<int>& values) {
+		const int count = static_cast<int>(keys.size());
+		const int numBlocks =
+		    std::max(1, std::min(MaxBlocks, count / MinBlock));
+		const int blockSize = (count + numBlocks - 1) / numBlocks;
+
+		scratchKeys.resize(count);
+		scratchValues.resize(count);
+
+		for (int shift = 0; shift < 32; shift += RadixBits) {
+			getTaskScheduler().parallelFor(0, numBlocks, 1, [&](int b) {
+				auto&     histogram = histograms[b];
+				const int end       = std::min(count, (b + 1) * blockSize);
+				histogram.fill(0);
+				for (int i = b * blockSize; i < end; ++i) {
+					++histogram[(keys[i] >> shift) & (Buckets - 1)];
+				}
+			});
+
+			int  offset  = 0;
+			bool trivial = false;
+			for (int digit = 0; digit < Buckets; ++digit) {
+				int digitCount = 0;
+				for (int b = 0; b < numBlocks; ++b) {
+					const int n          = histograms[b][digit];
+					histograms[b][digit] = offset + digitCount;
+					digitCount += n;
+				}
+				trivial |= digitCount == count;
+				offset += digitCount;
+			}
+			if (trivial) continue;
+
+			getTaskScheduler().parallelFor(0, numBlocks, 1, [&](int b) {
+				auto&     histogram = histograms[b];
+				const int end       = std::min(count, (b + 1) * blockSize);
+				for (int i = b * blockSize; i < end; ++i) {
+					const int dst =
+					    histogram[(keys[i] >> shift) & (Buckets - 1)]++;
+					scratchKeys[dst]   = keys[i];
+					scratchValues[dst] = values[i];
+				}
+			});
+
+			keys.swap(scratchKeys);
+			values.swap(scratchValues);
+		}
+	}
+
+private:
+	std::array<std::array<int, Buckets>, MaxBlocks> histograms;
+	std::vector<uint32_t>                           scratchKeys;
+	std::vector<int>                                scratchValues;
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "solver.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+
+// Read-only copy of the particles after a step, along with where they were
+// before it.
+struct SolverSnapshot {
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<glm::vec2> previous;
+	std::vector<glm::vec2> position;
+	std::vector<float>     radius;
+	Solver::Stats          stats;
+
+	float             stepTime    = 0.f;
+	float             accumulator = 0.f;
+	Clock::time_point publishTime = {};
+
+	// How far the state shown at `now` has moved from `previous` towards
+	// `position`. The simulation runs one step ahead of the display, so this
+	// is the time the simulation owes, over the step time.
+	float getBlend(Clock::time_point now) const {
+		if (stepTime <= 0.f) return 1.f;
+		const float elapsed =
+		    std::chrono::duration<float>(now - publishTime).count();
+		return std::clamp((accumulator + elapsed) / stepTime, 0.f, 1.f);
+	}
+};
+
+struct SolverCommand {
+	enum class Type {
+		Spawn,
+		Clear,
+		WakeAll,
+		SetSettings,
+		SetStepTime,
+	};
+
+	Type             type;
+	Solver::Settings settings = {};
+	float            stepTime = 0.f;
+};
+
+// Steps a solver at a fixed rate on a thread of its own. The UI thread sends
+// commands through a lock-free queue and reads the newest snapshot, neither
+// side ever waits for the other. When the steps take longer than real time
+// the simulation slows down instead of the UI.
+class SimulationThread {
+	static constexpr float MaxLag = 0.25f;
+
+public:
+	SimulationThread() = default;
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+	~SimulationThread() { stop(); }
+
+	// Publishes the current state, then starts stepping.
+	void start() {
+		if (thread.joinable()) return;
+		publish(0.f);
+		running.store(true, std::memory_order_relaxed);
+		thread = std::thread([this] { run(); });
+	}
+
+	// Returns once the step in progress has finished.
+	void stop() {
+		if (!thread.joinable()) return;
+		running.store(false, std::memory_order_relaxed);
+		thread.join();
+	}
+
+	// Direct access, only while the thread is stopped.
+	Solver& getSolver() { return solver; }
+
+	// UI thread only. Fails when the queue is full.
+	bool send(const SolverCommand& command) { return commands.push(command); }
+
+	// UI thread only. Stays valid until the next call.
+	const SolverSnapshot& getSnapshot() { return snapshots.read(); }
+
+private:
+	void run() {
+		using Clock = SolverSnapshot::Clock;
+
+		Clock::time_point previous    = Clock::now();
+		float             accumulator = 0.f;
+		while (running.load(std::memory_order_relaxed)) {
+			processCommands();
+
+			const Clock::time_point now = Clock::now();
+			accumulator += std::chrono::duration<float>(now - previous).count();
+			accumulator = std::min(accumulator, MaxLag);
+			previous    = now;
+			if (accumulator < dt) {
+				std::this_thread::sleep_for(
+				    std::chrono::duration<float>(dt - accumulator));
+				continue;
+			}
+
+			solver.update(dt);
+			accumulator -= dt;
+			publish(accumulator);
+		}
+	}
+
+	void processCommands() {
+		SolverCommand command;
+		while (commands.pop(command)) {
+			switch (command.type) {
+			case SolverCommand::Type::Spawn:
+				solver.addObject();
+				break;
+			case SolverCommand::Type::Clear:
+				solver.clear();
+				break;
+			case SolverCommand::Type::WakeAll:
+				solver.wakeAll();
+				break;
+			case SolverCommand::Type::SetSettings:
+				solver.setSettings(command.settings);
+				break;
+			case SolverCommand::Type::SetStepTime:
+				solver.changeStepTime(dt, command.stepTime);
+				dt = command.stepTime;
+				break;
+			}
+		}
+	}
+
+	// `accumulator` is the time that was already due for the next step.
+	void publish(float accumulator) {
+		SolverSnapshot& snapshot = snapshots.getWriteBuffer();
+		snapshot.previous.clear();
+		snapshot.position.clear();
+		snapshot.radius.clear();
+		solver.applyStates(
+		    [&](glm::vec2 previous, glm::vec2 position, float radius) {
+			    snapshot.previous.push_back(previous);
+			    snapshot.position.push_back(position);
+			    snapshot.radius.push_back(radius);
+		    });
+		snapshot.stats       = solver.getStats();
+		snapshot.stepTime    = dt;
+		snapshot.accumulator = accumulator;
+		snapshot.publishTime = SolverSnapshot::Clock::now();
+		snapshots.publish();
+	}
+
+	Solver                         solver;
+	SpscQueue<SolverCommand, 1024> commands;
+	TripleBuffer<SolverSnapshot>   snapshots;
+	std::thread                    thread;
+	std::atomic<bool>              running{false};
+	float                          dt = 1.f / 60.f;
+};
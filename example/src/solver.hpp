@@ -1,88 +1,122 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <unordered_map>
+#include <memory>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <imgui/imgui.h>
 
-struct VerletObject {
-	glm::vec2 currentPosition  = {};
-	glm::vec2 previousPosition = {};
-	glm::vec2 acceleration     = {};
-	float     radius           = 5.f;
-	uint32_t  color            = 0xffffffff;
+#include "broadphase.hpp"
+#include "hierarchical_grid.hpp"
+#include "incremental_grid.hpp"
+#include "kernels.hpp"
+#include "neighbor_list.hpp"
+#include "particles.hpp"
+#include "radix_sort.hpp"
+#include "spatial_hash.hpp"
+#include "spatial_partition.hpp"
+#include "stencil_grid.hpp"
+#include "sweep_and_prune.hpp"
+#include "task_scheduler.hpp"
+#include "union_find.hpp"
+#include "xpbd.hpp"
 
-	void updatePosition(float dt) {
-		const glm::vec2 velocity = currentPosition - previousPosition;
-
-		previousPosition = currentPosition;
-
-		currentPosition += velocity + acceleration * dt * dt;
-
-		acceleration = {};
-	}
-
-	void accelerate(glm::vec2 acc) { acceleration += acc; }
-};
-
-namespace std {
-template <>
-struct hash<glm::ivec2> {
-	inline size_t operator()(const glm::ivec2& v) const {
-		std::hash<int> int_hasher;
-		return int_hasher(v.x) ^ int_hasher(v.y);
-	}
-};
-}  // namespace std
-
-static float CellSize = 50.f;
-struct SpatialPartition {
-	std::unordered_map<glm::ivec2, std::vector<int>> cells;
-
-	void clear() { cells.clear(); }
+class Solver {
+	static constexpr glm::vec2 Gravity = {0.0f, 982.f};
 
-	void insert(const VerletObject& o, int id) {
-		const auto [min, max] = getRange(o);
-		for (int y = min.y; y <= max.y; ++y) {
-			for (int x = min.x; x <= max.x; ++x) {
-				cells[glm::ivec2(x, y)].push_back(id);
-			}
-		}
-	}
+	// Distance at which two particles still count as touching. It has to
+	// cover how far pairs close in during the solver iterations of a substep.
+	static constexpr float ContactSlop = 2.f;
 
-	std::pair<glm::ivec2, glm::ivec2> getRange(const VerletObject& o) const {
-		const auto& p = o.currentPosition;
-		const float r = o.radius;
-		return {{static_cast<int>(std::floor((p.x - r) / CellSize)),
-		         static_cast<int>(std::floor((p.y - r) / CellSize))},
-		        {static_cast<int>(std::floor((p.x + r) / CellSize)),
-		         static_cast<int>(std::floor((p.y + r) / CellSize))}};
-	}
-
-	template <typename Fn>
-	void apply(const VerletObject& o, Fn fn) const {
-		const auto [min, max] = getRange(o);
-		for (int y = min.y; y <= max.y; ++y) {
-			for (int x = min.x; x <= max.x; ++x) {
-				auto it = cells.find({x, y});
-				if (it != cells.end()) {
-					for (int id : it->second) {
-						fn(id);
-					}
-				}
-			}
+public:
+	enum class CollisionMode : int {
+		Serial,
+		Colored,
+		Jacobi,
+		Tiled,
+		Islands,
+		Xpbd,
+	};
+
+	enum class BroadphaseType : int {
+		Grid,
+		SweepAndPrune,
+		HierarchicalGrid,
+		StencilGrid,
+		IncrementalGrid,
+		SpatialHash,
+	};
+
+	// The parameters the debug window edits, copied as a whole so the window
+	// can run on another thread than the solver. See getSettings().
+	struct Settings {
+		bool           useContainer;
+		float          mapRadius;
+		float          cellSize;
+		BroadphaseType broadphase;
+		CollisionMode  collisionMode;
+		bool           adaptiveSubSteps;
+		int            minSubSteps;
+		int            maxSubSteps;
+		float          maxStepDisplacement;
+		int            fixedSubSteps;
+		int            solverIterations;
+		int            reorderInterval;
+		bool           useSleeping;
+		float          sleepSpeed;
+		int            sleepFrames;
+		bool           useNeighborLists;
+		float          neighborSkin;
+		float          xpbdCompliance;
+		float          xpbdWarmStart;
+		float          jacobiRelaxation;
+	};
+
+	// What the debug window reports about the last update.
+	struct Stats {
+		int                  numObjects          = 0;
+		int                  numSleeping         = 0;
+		int                  numCollisions       = 0;
+		int                  numNeighborRebuilds = 0;
+		int                  numIslands          = 0;
+		int                  largestIsland       = 0;
+		int                  subSteps            = 0;
+		float                averageRadius       = 0.f;
+		std::array<char, 64> broadphase          = {};
+	};
+
+	Solver() { setBroadphase(BroadphaseType::Grid); }
+
+	void setBroadphase(BroadphaseType type) {
+		switch (type) {
+		case BroadphaseType::Grid:
+			broadphase = std::make_unique<GridBroadphase>();
+			break;
+		case BroadphaseType::SweepAndPrune:
+			broadphase = std::make_unique<SweepAndPrune>();
+			break;
+		case BroadphaseType::HierarchicalGrid:
+			broadphase = std::make_unique<HierarchicalGrid>();
+			break;
+		case BroadphaseType::StencilGrid:
+			broadphase = std::make_unique<StencilGrid>();
+			break;
+		case BroadphaseType::IncrementalGrid:
+			broadphase = std::make_unique<IncrementalGrid>();
+			break;
+		case BroadphaseType::SpatialHash:
+			broadphase = std::make_unique<SpatialHash>();
+			break;
 		}
+		broadphaseType = type;
+		neighborList.invalidate();
 	}
-};
-
-class Solver {
-	static constexpr glm::vec2 Gravity = {0.0f, 982.f};
 
-public:
 	void addObject() {
-		objects.push_back(VerletObject{
+		particles.add(VerletObject{
 		    .currentPosition = {static_cast<float>(rand()) / RAND_MAX, static_cast<float>(rand()) / RAND_MAX},
 		    .radius =
 		        (std::pow(static_cast<float>(rand()) / RAND_MAX, 4.f)) * 6.f +
@@ -90,109 +124,892 @@ public:
 		    .color = IM_COL32(rand() % 255, rand() % 255, rand() % 255, 255),
 		});
 
+		// Awake particles are kept in front of the sleeping ones
+		const int last = particles.size() - 1;
+		if (numAwake < last) {
+			particles.swap(numAwake, last);
+			invalidateSlots();
+		}
+		++numAwake;
+
 		averageRadius = 0.f;
-		for (auto& o : objects) {
-			averageRadius += o.radius;
+		minRadius     = particles.radius.front();
+		for (float r : particles.radius) {
+			averageRadius += r;
+			minRadius = std::min(minRadius, r);
 		}
-		averageRadius /= objects.size();
+		averageRadius /= particles.size();
+
+		invalidateCandidates();
 	}
 
 	void update(float dt) {
-		static constexpr int SubSteps = 8;
-		const float          subDt    = dt / static_cast<float>(SubSteps);
+		setSubSteps(adaptiveSubSteps ? chooseSubSteps() : fixedSubSteps);
+		const float subDt = dt / static_cast<float>(subSteps);
 
-		numCollisions = 0;
+		numCollisions       = 0;
+		numNeighborRebuilds = 0;
 
-		for (int i = 0; i < SubSteps; ++i) {
+		particles.stepStartX = particles.currentX;
+		particles.stepStartY = particles.currentY;
+
+		if (reorderInterval > 0 && ++framesSinceReorder >= reorderInterval) {
+			reorderParticles();
+			framesSinceReorder = 0;
+		}
+
+		for (int i = 0; i < subSteps; ++i) {
 			applyGravity();
 			applyConstraint();
 
-			partition.clear();
-			for (int id = 0; id < objects.size(); ++id) {
-				partition.insert(objects[id], id);
+			// Pairs pushed into contact while the substep is solved, earlier
+			// in the same pass or by an earlier iteration, have to be among
+			// the candidates already
+			const float skin = std::max(neighborSkin, ContactSlop);
+			if (collisionMode == CollisionMode::Tiled) {
+				tileGrid.build(particles, mapRadius, 0.f);
+			} else if (!useNeighborLists) {
+				findCandidates(ContactSlop);
+			} else if (neighborList.needsRebuild(particles, skin)) {
+				findCandidates(0.5f * skin);
+				candidates.prune(particles, skin);
+				neighborList.update(particles, skin);
+				++numNeighborRebuilds;
+			}
+
+			// Tiled mode finds its pairs per tile and never refreshes the
+			// candidates
+			if (solverIterations > 1 && collisionMode != CollisionMode::Tiled) {
+				buildContacts();
+			}
+			for (int iteration = 0; iteration < solverIterations; ++iteration) {
+				// The container is part of every iteration, otherwise the
+				// extra passes push the outer particles through it
+				if (iteration > 0) applyConstraint();
+
+				switch (collisionMode) {
+				case CollisionMode::Serial:
+					solveCollisions();
+					break;
+				case CollisionMode::Colored:
+					solveCollisionsColored();
+					break;
+				case CollisionMode::Jacobi:
+					solveCollisionsJacobi();
+					break;
+				case CollisionMode::Tiled:
+					solveCollisionsTiled();
+					break;
+				case CollisionMode::Islands:
+					if (iteration == 0) buildIslands();
+					solveCollisionsIslands();
+					break;
+				case CollisionMode::Xpbd:
+					solveCollisionsXpbd(iteration, subDt);
+					break;
+				}
 			}
-			solveCollisions();
 
 			updatePositions(subDt);
 		}
 
-		numCollisions /= SubSteps;
+		numCollisions /= subSteps * solverIterations;
+
+		updateSleeping(subDt);
+	}
+
+	void clear() {
+		particles.clear();
+		invalidateCandidates();
+		numAwake = 0;
+	}
+
+	// Verlet stores velocity as the distance moved during the last substep,
+	// so the next update with step `dt` needs it rescaled from `previousDt`.
+	void changeStepTime(float previousDt, float dt) {
+		if (previousDt == dt || previousDt <= 0.f) return;
+		scaleVelocities(particles.currentX.data(),
+		                particles.currentY.data(),
+		                particles.previousX.data(),
+		                particles.previousY.data(),
+		                particles.size(),
+		                dt / previousDt);
 	}
 
-	void clear() { objects.clear(); }
+	void wakeAll() {
+		for (int i = numAwake; i < particles.size(); ++i) {
+			wake(i);
+		}
+		numAwake = particles.size();
+	}
 
+	// Calls fn(previous, current, radius) for every particle, where
+	// `previous` is the position before the last update.
 	template <typename Fn>
-	void apply(Fn fn) const {
-		for (const auto& o : objects) {
-			fn(o);
+	void applyStates(Fn fn) const {
+		for (int i = 0; i < particles.size(); ++i) {
+			fn(particles.getStepStart(i),
+			   particles.getPosition(i),
+			   particles.radius[i]);
 		}
 	}
 
-	void debug() {
+	Settings getSettings() const {
+		return {
+		    .useContainer        = useContainer,
+		    .mapRadius           = mapRadius,
+		    .cellSize            = CellSize,
+		    .broadphase          = broadphaseType,
+		    .collisionMode       = collisionMode,
+		    .adaptiveSubSteps    = adaptiveSubSteps,
+		    .minSubSteps         = minSubSteps,
+		    .maxSubSteps         = maxSubSteps,
+		    .maxStepDisplacement = maxStepDisplacement,
+		    .fixedSubSteps       = fixedSubSteps,
+		    .solverIterations    = solverIterations,
+		    .reorderInterval     = reorderInterval,
+		    .useSleeping         = useSleeping,
+		    .sleepSpeed          = sleepSpeed,
+		    .sleepFrames         = sleepFrames,
+		    .useNeighborLists    = useNeighborLists,
+		    .neighborSkin        = neighborSkin,
+		    .xpbdCompliance      = xpbdCompliance,
+		    .xpbdWarmStart       = xpbdWarmStart,
+		    .jacobiRelaxation    = jacobiRelaxation,
+		};
+	}
+
+	void setSettings(const Settings& settings) {
+		const bool moveContainer = settings.useContainer != useContainer ||
+		                           settings.mapRadius != mapRadius;
+		if (settings.broadphase != broadphaseType) {
+			setBroadphase(settings.broadphase);
+		}
+		if (settings.collisionMode != collisionMode) {
+			invalidateCandidates();
+		}
+
+		useContainer        = settings.useContainer;
+		mapRadius           = settings.mapRadius;
+		CellSize            = settings.cellSize;
+		collisionMode       = settings.collisionMode;
+		adaptiveSubSteps    = settings.adaptiveSubSteps;
+		minSubSteps         = std::max(1, settings.minSubSteps);
+		maxSubSteps         = std::max(minSubSteps, settings.maxSubSteps);
+		maxStepDisplacement = settings.maxStepDisplacement;
+		fixedSubSteps       = std::max(1, settings.fixedSubSteps);
+		solverIterations    = std::max(1, settings.solverIterations);
+		reorderInterval     = settings.reorderInterval;
+		useSleeping         = settings.useSleeping;
+		sleepSpeed          = settings.sleepSpeed;
+		sleepFrames         = settings.sleepFrames;
+		useNeighborLists    = settings.useNeighborLists;
+		neighborSkin        = settings.neighborSkin;
+		xpbdCompliance      = settings.xpbdCompliance;
+		xpbdWarmStart       = settings.xpbdWarmStart;
+		jacobiRelaxation    = settings.jacobiRelaxation;
+
+		if (moveContainer) wakeAll();
+	}
+
+	Stats getStats() const {
+		Stats stats;
+		stats.numObjects          = particles.size();
+		stats.numSleeping         = particles.size() - numAwake;
+		stats.numCollisions       = numCollisions;
+		stats.numNeighborRebuilds = numNeighborRebuilds;
+		stats.numIslands          = static_cast<int>(islandRoots.size());
+		stats.largestIsland       = largestIsland;
+		stats.subSteps            = subSteps;
+		stats.averageRadius       = averageRadius;
+		broadphase->printStats(stats.broadphase.data(),
+		                       stats.broadphase.size());
+		return stats;
+	}
+
+	struct DebugInput {
+		bool settingsChanged = false;
+		bool wakeAll         = false;
+	};
+
+	// Draws the debug window for a solver that may be stepping on another
+	// thread. Edits go to `settings` and are reported back to the caller,
+	// which hands them to the solver.
+	static DebugInput debug(Settings& settings, const Stats& stats) {
+		DebugInput input;
 		if (ImGui::Begin("Verlet Debug")) {
-			ImGui::DragFloat("Map Radius", &mapRadius);
-			ImGui::DragFloat("Cell Size", &CellSize);
-			ImGui::Text("Number of Objects: %d", objects.size());
-			ImGui::Text("Number of Collisions: %d", numCollisions);
-			ImGui::Text("Average Radius: %f", averageRadius);
+			bool& changed = input.settingsChanged;
+			changed |= ImGui::Checkbox("Container", &settings.useContainer);
+			changed |= ImGui::DragFloat("Map Radius", &settings.mapRadius);
+			changed |= ImGui::DragFloat("Cell Size", &settings.cellSize);
+			static constexpr const char* Broadphases[] = {
+			    "Uniform Grid",
+			    "Sweep and Prune",
+			    "Hierarchical Grid",
+			    "Stencil Grid",
+			    "Incremental Grid",
+			    "Spatial Hash"};
+			changed |=
+			    ImGui::Combo("Broadphase",
+			                 reinterpret_cast<int*>(&settings.broadphase),
+			                 Broadphases,
+			                 IM_ARRAYSIZE(Broadphases));
+			if (stats.broadphase[0] != '\0') {
+				ImGui::Text("%s", stats.broadphase.data());
+			}
+			static constexpr const char* CollisionModes[] = {
+			    "Serial", "Colored", "Jacobi", "Tiled", "Islands", "XPBD"};
+			changed |=
+			    ImGui::Combo("Collision Mode",
+			                 reinterpret_cast<int*>(&settings.collisionMode),
+			                 CollisionModes,
+			                 IM_ARRAYSIZE(CollisionModes));
+			changed |= ImGui::Checkbox("Adaptive Sub Steps",
+			                           &settings.adaptiveSubSteps);
+			if (settings.adaptiveSubSteps) {
+				changed |= ImGui::DragInt("Min Sub Steps",
+				                          &settings.minSubSteps,
+				                          1.f,
+				                          1,
+				                          settings.maxSubSteps);
+				changed |= ImGui::DragInt("Max Sub Steps",
+				                          &settings.maxSubSteps,
+				                          1.f,
+				                          settings.minSubSteps,
+				                          64);
+				changed |= ImGui::DragFloat("Max Step Displacement",
+				                            &settings.maxStepDisplacement,
+				                            0.01f,
+				                            0.01f,
+				                            2.f);
+			} else {
+				changed |= ImGui::DragInt(
+				    "Sub Steps", &settings.fixedSubSteps, 1.f, 1, 64);
+			}
+			ImGui::Text("Sub Steps: %d", stats.subSteps);
+			changed |= ImGui::DragInt(
+			    "Solver Iterations", &settings.solverIterations, 1.f, 1, 16);
+			changed |= ImGui::DragInt(
+			    "Reorder Interval", &settings.reorderInterval, 1.f, 0, 600);
+			changed |= ImGui::Checkbox("Sleeping", &settings.useSleeping);
+			if (settings.useSleeping) {
+				changed |= ImGui::DragFloat(
+				    "Sleep Speed", &settings.sleepSpeed, 0.1f, 0.f, 100.f);
+				changed |= ImGui::DragInt(
+				    "Sleep Frames", &settings.sleepFrames, 1.f, 1, 600);
+				ImGui::Text("Sleeping Objects: %d", stats.numSleeping);
+				input.wakeAll = ImGui::Button("Wake All");
+			}
+			changed |=
+			    ImGui::Checkbox("Neighbor Lists", &settings.useNeighborLists);
+			if (settings.useNeighborLists) {
+				changed |= ImGui::DragFloat(
+				    "Neighbor Skin", &settings.neighborSkin, 0.1f, 0.f, 50.f);
+				ImGui::Text("Neighbor Rebuilds: %d", stats.numNeighborRebuilds);
+			}
+			if (settings.collisionMode == CollisionMode::Islands) {
+				ImGui::Text("Islands: %d (largest %d)",
+				            stats.numIslands,
+				            stats.largestIsland);
+			}
+			if (settings.collisionMode == CollisionMode::Xpbd) {
+				changed |= ImGui::DragFloat("Compliance",
+				                            &settings.xpbdCompliance,
+				                            1e-10f,
+				                            0.f,
+				                            1e-5f,
+				                            "%.2e");
+				changed |= ImGui::DragFloat(
+				    "Warm Start", &settings.xpbdWarmStart, 0.01f, 0.f, 1.f);
+			}
+			if (settings.collisionMode == CollisionMode::Jacobi) {
+				changed |= ImGui::DragFloat("Jacobi Relaxation",
+				                            &settings.jacobiRelaxation,
+				                            0.01f,
+				                            0.f,
+				                            1.f);
+			}
+			ImGui::Text("Number of Objects: %d", stats.numObjects);
+			ImGui::Text("Number of Collisions: %d", stats.numCollisions);
+			ImGui::Text("Average Radius: %f", stats.averageRadius);
+			ImGui::Text("SIMD: %s", getSimdName());
+			if (getActiveIsa() != detectedIsa) {
+				ImGui::Text("Detected SIMD: %s", getIsaName(detectedIsa));
+			}
 		}
 		ImGui::End();
+		return input;
 	}
 
-	const float getMapRadius() const { return mapRadius; }
-
 private:
-	void updatePositions(float dt) {
-		for (auto& o : objects) {
-			o.updatePosition(dt);
+	// Picks enough substeps that, at the current speeds, no particle moves
+	// further than `maxStepDisplacement` times the smallest radius per
+	// substep, which keeps fast particles from tunneling through small ones.
+	// Every change of the step size disturbs resting contacts, so the count
+	// rises at once but only falls by one after `CalmFrames` frames that
+	// would have been fine with fewer substeps.
+	int chooseSubSteps() {
+		static constexpr int CalmFrames = 30;
+
+		const float step =
+		    std::sqrt(maxDisplacement2(particles.currentX.data(),
+		                               particles.currentY.data(),
+		                               particles.previousX.data(),
+		                               particles.previousY.data(),
+		                               numAwake));
+		const float frame = step * static_cast<float>(subSteps);
+		const float limit = maxStepDisplacement * minRadius;
+		const int   needed =
+		    limit > 0.f ? static_cast<int>(std::ceil(frame / limit))
+		                : maxSubSteps;
+
+		int count = subSteps;
+		if (needed > subSteps) {
+			count      = needed;
+			calmFrames = 0;
+		} else if (needed < subSteps && ++calmFrames >= CalmFrames) {
+			count      = subSteps - 1;
+			calmFrames = 0;
 		}
+		return std::clamp(count, minSubSteps, maxSubSteps);
 	}
 
-	void applyGravity() {
-		for (auto& o : objects) {
-			o.accelerate(Gravity);
+	// Verlet stores velocity as the distance moved during the last step, so
+	// it has to be rescaled whenever the step size changes.
+	void setSubSteps(int count) {
+		if (count == subSteps) return;
+		scaleVelocities(particles.currentX.data(),
+		                particles.currentY.data(),
+		                particles.previousX.data(),
+		                particles.previousY.data(),
+		                particles.size(),
+		                static_cast<float>(subSteps) / static_cast<float>(count));
+		subSteps = count;
+	}
+
+	// Sorts the particles along a Morton curve so that particles close in
+	// space are also close in memory.
+	void reorderParticles() {
+		const int   count  = particles.size();
+		const float extent = mapRadius + CellSize;
+		const float scale  = 65535.f / (2.f * extent);
+
+		sortKeys.resize(count);
+		sortOrder.resize(count);
+		getTaskScheduler().parallelFor(0, count, [&](int i) {
+			const auto p = glm::clamp(
+			    (particles.getPosition(i) + glm::vec2(extent)) * scale,
+			    glm::vec2(0.f),
+			    glm::vec2(65535.f));
+			sortKeys[i]  = mortonCode(static_cast<uint32_t>(p.x),
+			                          static_cast<uint32_t>(p.y));
+			sortOrder[i] = i;
+		});
+
+		radixSort.sort(sortKeys, sortOrder);
+		std::stable_partition(sortOrder.begin(),
+		                      sortOrder.end(),
+		                      [&](int i) { return i < numAwake; });
+		particles.permute(sortOrder);
+		invalidateSlots();
+	}
+
+	// Everything that refers to particles by slot is stale once the
+	// particles have been moved in memory.
+	void invalidateSlots() {
+		broadphase->invalidate();
+		neighborList.invalidate();
+		xpbdContacts.invalidate();
+	}
+
+	// The colored mode needs a grid built from the same positions and margin
+	// as the candidates, which the uniform grid broadphase already provides.
+	void findCandidates(float margin) {
+		broadphase->findCandidates(
+		    particles, numAwake, mapRadius, margin, candidates);
+		if (collisionMode == CollisionMode::Colored &&
+		    !broadphase->getPartition()) {
+			coloringPartition.build(particles, mapRadius, margin);
 		}
 	}
 
+	const SpatialPartition& getColoringPartition() const {
+		const SpatialPartition* partition = broadphase->getPartition();
+		return partition ? *partition : coloringPartition;
+	}
+
+	void updatePositions(float dt) {
+		integrate(particles.currentX.data(),
+		          particles.currentY.data(),
+		          particles.previousX.data(),
+		          particles.previousY.data(),
+		          particles.accelerationX.data(),
+		          particles.accelerationY.data(),
+		          numAwake,
+		          dt);
+	}
+
+	void applyGravity() {
+		accelerate(particles.accelerationX.data(),
+		           particles.accelerationY.data(),
+		           numAwake,
+		           Gravity);
+	}
+
 	void applyConstraint() {
 		static constexpr glm::vec2 center = {0, 0};
 
-		for (auto& o : objects) {
-			const auto  toObj = o.currentPosition - center;
-			const float dist  = glm::length(toObj);
-			if (dist > mapRadius - o.radius) {
-			    const auto n      = toObj / dist;
-			    o.currentPosition = center + n * (mapRadius - o.radius);
+		if (!useContainer) return;
+
+		constrain(particles.currentX.data(),
+		          particles.currentY.data(),
+		          particles.radius.data(),
+		          numAwake,
+		          center,
+		          mapRadius);
+	}
+
+	void solveCollisions() {
+		for (int i = 0; i < numAwake; ++i) {
+			numCollisions += solveObject(i);
+		}
+	}
+
+	// Gauss-Seidel over a 3x3 coloring of blocks of `span` cells. Blocks of
+	// the same color are at least two spans apart, so they never touch the
+	// same objects and can be solved concurrently.
+	void solveCollisionsColored() {
+		const SpatialPartition& partition = getColoringPartition();
+		const int               blockSize = std::max(1, partition.span);
+		const glm::ivec2        numBlocks =
+		    (partition.dimensions + glm::ivec2(blockSize - 1)) / blockSize;
+
+		TaskScheduler& scheduler  = getTaskScheduler();
+		int            collisions = 0;
+		for (int color = 0; color < 9; ++color) {
+			const glm::ivec2 offset = {color % 3, color / 3};
+			const glm::ivec2 colorBlocks =
+			    (numBlocks - offset + glm::ivec2(2)) / 3;
+			const int count = colorBlocks.x * colorBlocks.y;
+
+			collisions += scheduler.parallelSum(0, count, 1, [&](int b) {
+				const glm::ivec2 block =
+				    offset + 3 * glm::ivec2(b % colorBlocks.x, b / colorBlocks.x);
+				const glm::ivec2 min = block * blockSize;
+				const glm::ivec2 max =
+				    glm::min(min + glm::ivec2(blockSize), partition.dimensions);
+				return solveBlock(partition, min, max);
+			});
+		}
+		numCollisions += collisions;
+	}
+
+	int solveBlock(const SpatialPartition& partition,
+	               glm::ivec2              min,
+	               glm::ivec2              max) {
+		int collisions = 0;
+		for (int y = min.y; y < max.y; ++y) {
+			for (int x = min.x; x < max.x; ++x) {
+				const int cell = x + y * partition.dimensions.x;
+				for (int i = partition.cellStart[cell];
+				     i < partition.cellStart[cell + 1];
+				     ++i) {
+					const int id = partition.cellObjects[i];
+					if (id < numAwake && partition.isOwner(id, x, y)) {
+						collisions += solveObject(id);
+					}
+				}
 			}
 		}
+		return collisions;
 	}
 
-	void solveCollisions() {
-		for (int i = 0; i < objects.size(); ++i) {
-			auto& a = objects[i];
-			partition.apply(a, [&](int id) {
-				if (id <= i) return;
-				auto& b = objects[id];
-
-				const auto collisionAxis =
-				    a.currentPosition - b.currentPosition;
-				const float dist = glm::length(collisionAxis);
-				if (dist > 0.f && dist < a.radius + b.radius) {
-					const auto  n     = collisionAxis / dist;
-					const float delta = (a.radius + b.radius) - dist;
-					a.currentPosition += 0.5f * delta * n;
-					b.currentPosition -= 0.5f * delta * n;
-
-					++numCollisions;
+	// Computes every correction from the positions at the start of the pass
+	// into per-chunk contact buffers, then applies them chunk by chunk. The
+	// chunks do not depend on the number of threads, so neither does the
+	// order of the floating point additions.
+	void solveCollisionsJacobi() {
+		static constexpr int ChunkSize = 256;
+
+		const int numChunks = (numAwake + ChunkSize - 1) / ChunkSize;
+		if (static_cast<int>(contactChunks.size()) < numChunks) {
+			contactChunks.resize(numChunks);
+		}
+
+		getTaskScheduler().parallelFor(0, numChunks, 1, [&](int chunk) {
+			auto& contacts = contactChunks[chunk];
+			contacts.clear();
+
+			const int end = std::min(numAwake, (chunk + 1) * ChunkSize);
+			for (int i = chunk * ChunkSize; i < end; ++i) {
+				const glm::vec2 position = particles.getPosition(i);
+				const float     radius   = particles.radius[i];
+				forEachCandidate(i, [&](int id) {
+					const auto collisionAxis =
+					    position - particles.getPosition(id);
+					const float dist2   = glm::dot(collisionAxis, collisionAxis);
+					const float minDist = radius + particles.radius[id];
+					if (dist2 > 0.f && dist2 < minDist * minDist) {
+						const float dist  = std::sqrt(dist2);
+						const float scale = 0.5f * jacobiRelaxation *
+						                    (minDist - dist) / dist;
+						contacts.push_back({i, id, collisionAxis * scale});
+					}
+				});
+			}
+		});
+
+		for (int chunk = 0; chunk < numChunks; ++chunk) {
+			for (const auto& c : contactChunks[chunk]) {
+				particles.setPosition(c.a,
+				                      particles.getPosition(c.a) + c.correction);
+				particles.setPosition(c.b,
+				                      particles.getPosition(c.b) - c.correction);
+			}
+			numCollisions += static_cast<int>(contactChunks[chunk].size());
+		}
+	}
+
+	// Solves the grid one tile at a time. A cell and its half neighborhood
+	// are copied into a small contiguous block, solved there and written
+	// back, so the inner loop works on cached data instead of chasing ids.
+	void solveCollisionsTiled() {
+		const glm::ivec2 dimensions = tileGrid.getDimensions();
+		for (int y = 0; y < dimensions.y; ++y) {
+			for (int x = 0; x < dimensions.x; ++x) {
+				const int own = tileGrid.gatherTile(x, y, tile.ids);
+				const auto isAsleep = [&](int id) { return id >= numAwake; };
+				if (own == 0 ||
+				    std::all_of(tile.ids.begin(), tile.ids.end(), isAsleep)) {
+					continue;
+				}
+
+				const int count = static_cast<int>(tile.ids.size());
+				tile.x.resize(count);
+				tile.y.resize(count);
+				tile.radius.resize(count);
+				while (static_cast<int>(tile.others.size()) < count) {
+					tile.others.push_back(static_cast<int>(tile.others.size()));
+				}
+				tile.awake.clear();
+				for (int i = 0; i < count; ++i) {
+					const int id   = tile.ids[i];
+					tile.x[i]      = particles.currentX[id];
+					tile.y[i]      = particles.currentY[id];
+					tile.radius[i] = particles.radius[id];
+					if (!isAsleep(id)) tile.awake.push_back(i);
+				}
+
+				for (int i = 0; i < own; ++i) {
+					const int* others    = tile.others.data() + i + 1;
+					int        numOthers = count - i - 1;
+					// Two sleepers are left where they are
+					if (isAsleep(tile.ids[i])) {
+						const auto first = std::upper_bound(
+						    tile.awake.begin(), tile.awake.end(), i);
+						if (first == tile.awake.end()) continue;
+						others    = &*first;
+						numOthers = static_cast<int>(tile.awake.end() - first);
+					}
+					numCollisions += solveContacts(tile.x.data(),
+					                               tile.y.data(),
+					                               tile.radius.data(),
+					                               i,
+					                               others,
+					                               numOthers);
+				}
+
+				for (int i = 0; i < count; ++i) {
+					const int id           = tile.ids[i];
+					particles.currentX[id] = tile.x[i];
+					particles.currentY[id] = tile.y[i];
+				}
+			}
+		}
+	}
+
+	// A particle is at rest once it moved less than `sleepSpeed` during the
+	// last substep for `sleepFrames` frames. Touching particles form an
+	// island, which only falls asleep when all of its particles are at rest.
+	// Sleeping particles are not integrated or solved against each other,
+	// but awake particles still collide with them and wake them up unless
+	// their own island is at rest as well.
+	void updateSleeping(float dt) {
+		const int count = particles.size();
+		if (!useSleeping) {
+			if (numAwake < count) wakeAll();
+			return;
+		}
+
+		const float limit = sleepSpeed * dt;
+		for (int i = 0; i < numAwake; ++i) {
+			const glm::vec2 v = particles.getPosition(i) -
+			                    glm::vec2(particles.previousX[i],
+			                              particles.previousY[i]);
+			particles.restFrames[i] =
+			    glm::dot(v, v) < limit * limit ? particles.restFrames[i] + 1
+			                                   : 0;
+		}
+
+		// The candidates of the last substep were searched with ContactSlop,
+		// tiled mode solves without them and needs a search of its own
+		if (collisionMode == CollisionMode::Tiled) {
+			tileGrid.findCandidates(
+			    particles, numAwake, mapRadius, ContactSlop, candidates);
+		}
+		islands.reset(count);
+		for (int i = 0; i < numAwake; ++i) {
+			const glm::vec2 position = particles.getPosition(i);
+			const float     radius   = particles.radius[i] + ContactSlop;
+			candidates.apply(i, [&](int id) {
+				const auto  axis  = position - particles.getPosition(id);
+				const float range = radius + particles.radius[id];
+				if (glm::dot(axis, axis) < range * range) {
+					islands.unite(i, id);
 				}
 			});
 		}
+		// Sleepers are no candidates of each other, they stay joined by the
+		// island they fell asleep with
+		islandFirst.assign(count, -1);
+		for (int i = numAwake; i < count; ++i) {
+			int& first = islandFirst[particles.island[i]];
+			if (first < 0) {
+				first = i;
+			} else {
+				islands.unite(first, i);
+			}
+		}
+
+		islandAtRest.assign(count, 1);
+		for (int i = 0; i < numAwake; ++i) {
+			if (particles.restFrames[i] < sleepFrames) {
+				islandAtRest[islands.find(i)] = 0;
+			}
+		}
+
+		sleepOrder.clear();
+		for (int i = 0; i < count; ++i) {
+			if (!islandAtRest[islands.find(i)]) sleepOrder.push_back(i);
+		}
+		const int awake = static_cast<int>(sleepOrder.size());
+		for (int i = 0; i < count; ++i) {
+			const int root = islands.find(i);
+			if (islandAtRest[root]) {
+				sleepOrder.push_back(i);
+				particles.island[i] = root;
+			}
+		}
+		if (awake == numAwake &&
+		    (awake == 0 || sleepOrder[awake - 1] == awake - 1)) {
+			return;
+		}
+
+		for (int i = numAwake; i < count; ++i) {
+			if (!islandAtRest[islands.find(i)]) wake(i);
+		}
+		particles.permute(sleepOrder);
+		numAwake = awake;
+		invalidateSlots();
+	}
+
+	// Woken particles start from rest, whatever they were pushed by while
+	// asleep.
+	void wake(int i) {
+		particles.previousX[i]  = particles.currentX[i];
+		particles.previousY[i]  = particles.currentY[i];
+		particles.restFrames[i] = 0;
+	}
+
+	// Splits the awake particles into islands connected by candidate pairs
+	// and groups them by island in index order, largest island first.
+	void buildIslands() {
+		const int count = particles.size();
+
+		contactIslands.reset(count);
+		for (int i = 0; i < numAwake; ++i) {
+			forEachCandidate(i, [&](int id) { contactIslands.unite(i, id); });
+		}
+
+		islandOf.resize(numAwake);
+		islandStart.assign(count + 1, 0);
+		for (int i = 0; i < numAwake; ++i) {
+			islandOf[i] = contactIslands.find(i);
+			++islandStart[islandOf[i]];
+		}
+		islandRoots.clear();
+		for (int root = 0; root < count; ++root) {
+			if (islandStart[root] > 0) islandRoots.push_back(root);
+		}
+		for (int i = 1; i <= count; ++i) {
+			islandStart[i] += islandStart[i - 1];
+		}
+		islandObjects.resize(numAwake);
+		for (int i = numAwake - 1; i >= 0; --i) {
+			islandObjects[--islandStart[islandOf[i]]] = i;
+		}
+
+		const auto islandSize = [&](int root) {
+			return islandStart[root + 1] - islandStart[root];
+		};
+		const auto isLarger = [&](int a, int b) {
+			return islandSize(a) > islandSize(b);
+		};
+		std::stable_sort(islandRoots.begin(), islandRoots.end(), isLarger);
+		largestIsland = islandRoots.empty() ? 0 : islandSize(islandRoots[0]);
 	}
 
-	std::vector<VerletObject> objects;
-	SpatialPartition          partition;
+	// Islands never share a particle, so each one is solved in index order
+	// on a single thread while different islands run concurrently, which
+	// gives exactly the result of the serial solve.
+	void solveCollisionsIslands() {
+		const int numIslands = static_cast<int>(islandRoots.size());
+		const auto solveIsland = [&](int k) {
+			const int root       = islandRoots[k];
+			int       collisions = 0;
+			for (int i = islandStart[root]; i < islandStart[root + 1]; ++i) {
+				collisions += solveObject(islandObjects[i]);
+			}
+			return collisions;
+		};
+		numCollisions +=
+		    getTaskScheduler().parallelSum(0, numIslands, 1, solveIsland);
+	}
+
+	int solveObject(int i) {
+		static constexpr int BatchSize = 32;
+
+		std::array<int, BatchSize> batch;
+
+		int collisions = 0;
+		int count      = 0;
+		forEachCandidate(i, [&](int id) {
+			batch[count++] = id;
+			if (count == BatchSize) {
+				collisions += solveContactBatch(i, batch.data(), count);
+				count = 0;
+			}
+		});
+		return collisions + solveContactBatch(i, batch.data(), count);
+	}
+
+	// Drops the pairs found for an older set of particles, every mode that
+	// uses them finds new ones before its next solve.
+	void invalidateCandidates() {
+		candidates.reset(0);
+		contactList.reset(0);
+		neighborList.invalidate();
+		xpbdContacts.invalidate();
+	}
+
+	// Gathers the candidate pairs that are touching into a compact contact
+	// list, so that further solver iterations within the substep skip the
+	// pairs that are merely close.
+	void buildContacts() {
+		contactList = candidates;
+		contactList.prune(particles, ContactSlop);
+	}
+
+	void solveCollisionsXpbd(int iteration, float dt) {
+		const CandidateList& contacts = getContacts();
+		if (iteration == 0) {
+			xpbdContacts.beginStep(contacts, xpbdWarmStart);
+		}
+		numCollisions += xpbdContacts.solve(
+		    particles, contacts, numAwake, xpbdCompliance, dt);
+		if (iteration + 1 == solverIterations) {
+			xpbdContacts.endStep(contacts);
+		}
+	}
+
+	const CandidateList& getContacts() const {
+		return solverIterations > 1 ? contactList : candidates;
+	}
+
+	// Calls fn for every potential collision partner of `id` with a higher
+	// index.
+	template <typename Fn>
+	void forEachCandidate(int id, Fn fn) const {
+		getContacts().apply(id, fn);
+	}
+
+	int solveContactBatch(int id, const int* others, int count) {
+		return solveContacts(particles.currentX.data(),
+		                     particles.currentY.data(),
+		                     particles.radius.data(),
+		                     id,
+		                     others,
+		                     count);
+	}
 
-	float mapRadius     = 450.f;
-	float averageRadius = 0.f;
-	int   numCollisions = 0;
+	Particles                   particles;
+	std::unique_ptr<Broadphase> broadphase;
+	BroadphaseType              broadphaseType;
+	CandidateList               candidates;
+	CandidateList               contactList;
+	SpatialPartition            coloringPartition;
+	NeighborList                neighborList;
+	CollisionMode               collisionMode = CollisionMode::Serial;
+
+	struct Contact {
+		int       a;
+		int       b;
+		glm::vec2 correction;
+	};
+	std::vector<std::vector<Contact>> contactChunks;
+
+	struct Tile {
+		std::vector<int>   ids;
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> radius;
+		std::vector<int>   others;
+		std::vector<int>   awake;
+	};
+	StencilGrid tileGrid;
+	Tile        tile;
+
+	XpbdContacts xpbdContacts;
+
+	UnionFind        contactIslands;
+	std::vector<int> islandOf;
+	std::vector<int> islandStart;
+	std::vector<int> islandObjects;
+	std::vector<int> islandRoots;
+	int              largestIsland = 0;
+
+	UnionFind            islands;
+	std::vector<int>     islandFirst;
+	std::vector<uint8_t> islandAtRest;
+	std::vector<int>     sleepOrder;
+
+	RadixSort             radixSort;
+	std::vector<uint32_t> sortKeys;
+	std::vector<int>      sortOrder;
+
+	bool  useContainer        = true;
+	float mapRadius           = 450.f;
+	float averageRadius       = 0.f;
+	float minRadius           = 0.f;
+	float jacobiRelaxation    = 0.75f;
+	int   numCollisions       = 0;
+	int   reorderInterval     = 60;
+	int   framesSinceReorder  = 0;
+	bool  useNeighborLists    = false;
+	float neighborSkin        = 4.f;
+	int   numNeighborRebuilds = 0;
+	bool  adaptiveSubSteps    = true;
+	int   minSubSteps         = 6;
+	int   maxSubSteps         = 16;
+	int   fixedSubSteps       = 8;
+	float maxStepDisplacement = 0.25f;
+	int   subSteps            = 8;
+	int   calmFrames          = 0;
+	bool  useSleeping         = false;
+	float sleepSpeed          = 10.f;
+	int   sleepFrames         = 60;
+	int   numAwake            = 0;
+	int   solverIterations    = 1;
+	float xpbdCompliance      = 1e-8f;
+	float xpbdWarmStart       = 0.9f;
 };
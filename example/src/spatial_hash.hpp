@@ -0,0 +1,161 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+#include "spatial_partition.hpp"
+
+// Sparse single-insertion grid without bounds. Occupied cells are found
+// through an open addressing hash table with linear probing. Slots belong to
+// a generation, bumping it empties the whole table without touching it.
+class SpatialHash : public Broadphase {
+	struct Slot {
+		uint64_t key        = 0;
+		uint32_t generation = 0;
+		int      cell       = 0;
+	};
+
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		(void)mapRadius;
+		const int count = particles.size();
+
+		float maxRadius = 0.f;
+		for (float r : particles.radius) {
+			maxRadius = std::max(maxRadius, r);
+		}
+		cellSize = std::max(CellSize, 2.f * (maxRadius + margin));
+
+		clear(count);
+		cellOf.resize(count);
+		for (int id = 0; id < count; ++id) {
+			cellOf[id] = insert(getCell(particles.getPosition(id)));
+			++cellStart[cellOf[id]];
+		}
+
+		const int numCells = static_cast<int>(cellCoords.size());
+		cellStart.push_back(0);
+		for (int i = 1; i <= numCells; ++i) {
+			cellStart[i] += cellStart[i - 1];
+		}
+		cellObjects.resize(count);
+		for (int id = count - 1; id >= 0; --id) {
+			cellObjects[--cellStart[cellOf[id]]] = id;
+		}
+
+		pairs.clear();
+		for (int cell = 0; cell < numCells; ++cell) {
+			const auto objects = getObjects(cell);
+			findPairs(particles, numAwake, margin, objects, objects, pairs);
+			for (const auto& offset : HalfStencil) {
+				const int neighbor = find(cellCoords[cell] + offset);
+				if (neighbor >= 0) {
+					findPairs(particles,
+					          numAwake,
+					          margin,
+					          objects,
+					          getObjects(neighbor),
+					          pairs);
+				}
+			}
+		}
+
+		candidates.assign(count, pairs);
+	}
+
+	void printStats(char* text, size_t size) const override {
+		std::snprintf(text,
+		              size,
+		              "Hash Cells: %d / %d",
+		              static_cast<int>(cellCoords.size()),
+		              static_cast<int>(slots.size()));
+	}
+
+private:
+	static uint64_t getKey(glm::ivec2 cell) {
+		return (static_cast<uint64_t>(static_cast<uint32_t>(cell.x)) << 32) |
+		       static_cast<uint32_t>(cell.y);
+	}
+
+	// Finalizer of MurmurHash3, every input bit affects every output bit so
+	// neighboring and diagonal cells spread over the whole table.
+	static uint64_t mix(uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Empties the table and makes sure it stays at most half full with
+	// `count` occupied cells.
+	void clear(int count) {
+		size_t capacity = std::max<size_t>(slots.size(), 16);
+		while (capacity < 2 * static_cast<size_t>(count)) {
+			capacity *= 2;
+		}
+		if (capacity != slots.size() || ++generation == 0) {
+			slots.assign(capacity, {});
+			generation = 1;
+		}
+		cellCoords.clear();
+		cellStart.clear();
+	}
+
+	int insert(glm::ivec2 cell) {
+		const uint64_t key  = getKey(cell);
+		const size_t   mask = slots.size() - 1;
+		for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+			Slot& slot = slots[i];
+			if (slot.generation != generation) {
+				slot = {key, generation, static_cast<int>(cellCoords.size())};
+				cellCoords.push_back(cell);
+				cellStart.push_back(0);
+				return slot.cell;
+			}
+			if (slot.key == key) return slot.cell;
+		}
+	}
+
+	int find(glm::ivec2 cell) const {
+		const uint64_t key  = getKey(cell);
+		const size_t   mask = slots.size() - 1;
+		for (size_t i = mix(key) & mask;; i = (i + 1) & mask) {
+			const Slot& slot = slots[i];
+			if (slot.generation != generation) return -1;
+			if (slot.key == key) return slot.cell;
+		}
+	}
+
+	glm::ivec2 getCell(glm::vec2 p) const {
+		return glm::ivec2(glm::floor(p / cellSize));
+	}
+
+	std::span<const int> getObjects(int cell) const {
+		return {cellObjects.data() + cellStart[cell],
+		        cellObjects.data() + cellStart[cell + 1]};
+	}
+
+	float                            cellSize   = 0.f;
+	uint32_t                         generation = 0;
+	std::vector<Slot>                slots;
+	std::vector<glm::ivec2>          cellCoords;
+	std::vector<int>                 cellStart;
+	std::vector<int>                 cellObjects;
+	std::vector<int>                 cellOf;
+	std::vector<std::pair<int, int>> pairs;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+#include "task_scheduler.hpp"
+
+static float CellSize = 50.f;
+struct SpatialPartition {
+	static constexpr int MaxBlocks = 64;
+	static constexpr int MinBlock  = 4096;
+
+	glm::vec2               origin     = {};
+	glm::ivec2              dimensions = {};
+	std::vector<int>        cellStart;
+	std::vector<int>        cellObjects;
+	std::vector<glm::ivec2> rangeMin;
+	std::vector<glm::ivec2> rangeMax;
+	int                     span   = 0;
+	float                   margin = 0.f;
+
+	// Objects are inserted with their radius grown by `margin`, which lets
+	// the partition report pairs that are about to collide.
+	//
+	// The build is a parallel counting sort over a fixed number of blocks of
+	// ids: every block histograms its own entries, the histograms are turned
+	// into per-block offsets with a scan over the cells, then every block
+	// scatters its ids without any synchronization. Cells list their objects
+	// in id order, regardless of the number of threads.
+	void build(const Particles& particles,
+	           float            mapRadius,
+	           float            radiusMargin = 0.f) {
+		margin = radiusMargin;
+
+		// Pad by one cell so objects touching the container keep their cells
+		const float extent = mapRadius + CellSize;
+		origin             = glm::vec2(-extent, -extent);
+		dimensions         = glm::ivec2(std::max(
+		    1, static_cast<int>(std::ceil(2.f * extent / CellSize))));
+
+		const int count    = particles.size();
+		const int numCells = dimensions.x * dimensions.y;
+		const int numBlocks =
+		    std::max(1, std::min({MaxBlocks, count / MinBlock, count / numCells}));
+		const int blockSize = (count + numBlocks - 1) / numBlocks;
+
+		rangeMin.resize(count);
+		rangeMax.resize(count);
+		blockCounts.assign(numBlocks * numCells, 0);
+		blockSpans.assign(numBlocks, 0);
+
+		getTaskScheduler().parallelFor(0, numBlocks, 1, [&](int b) {
+			int* const counts    = blockCounts.data() + b * numCells;
+			const int  end       = std::min(count, (b + 1) * blockSize);
+			int        blockSpan = 0;
+			for (int id = b * blockSize; id < end; ++id) {
+				const auto [min, max] = getRange(particles, id);
+				rangeMin[id]          = min;
+				rangeMax[id]          = max;
+				blockSpan = std::max({blockSpan, max.x - min.x, max.y - min.y});
+				for (int y = min.y; y <= max.y; ++y) {
+					for (int x = min.x; x <= max.x; ++x) {
+						++counts[x + y * dimensions.x];
+					}
+				}
+			}
+			blockSpans[b] = blockSpan;
+		});
+		span = *std::max_element(blockSpans.begin(), blockSpans.end());
+
+		const int numChunks =
+		    std::max(1, std::min(MaxBlocks, numCells / MinBlock));
+		const int chunkSize = (numCells + numChunks - 1) / numChunks;
+
+		std::array<int, MaxBlocks + 1> chunkStart = {};
+		getTaskScheduler().parallelFor(0, numChunks, 1, [&](int c) {
+			const int end   = std::min(numCells, (c + 1) * chunkSize);
+			int       total = 0;
+			for (int cell = c * chunkSize; cell < end; ++cell) {
+				for (int b = 0; b < numBlocks; ++b) {
+					total += blockCounts[b * numCells + cell];
+				}
+			}
+			chunkStart[c + 1] = total;
+		});
+		for (int c = 1; c <= numChunks; ++c) {
+			chunkStart[c] += chunkStart[c - 1];
+		}
+
+		cellStart.resize(numCells + 1);
+		getTaskScheduler().parallelFor(0, numChunks, 1, [&](int c) {
+			const int end    = std::min(numCells, (c + 1) * chunkSize);
+			int       offset = chunkStart[c];
+			for (int cell = c * chunkSize; cell < end; ++cell) {
+				cellStart[cell] = offset;
+				for (int b = 0; b < numBlocks; ++b) {
+					const int n = blockCounts[b * numCells + cell];
+					blockCounts[b * numCells + cell] = offset;
+					offset += n;
+				}
+			}
+		});
+		cellStart[numCells] = chunkStart[numChunks];
+
+		cellObjects.resize(chunkStart[numChunks]);
+		getTaskScheduler().parallelFor(0, numBlocks, 1, [&](int b) {
+			int* const offsets = blockCounts.data() + b * numCells;
+			const int  end     = std::min(count, (b + 1) * blockSize);
+			for (int id = b * blockSize; id < end; ++id) {
+				const auto min = rangeMin[id];
+				const auto max = rangeMax[id];
+				for (int y = min.y; y <= max.y; ++y) {
+					for (int x = min.x; x <= max.x; ++x) {
+						cellObjects[offsets[x + y * dimensions.x]++] = id;
+					}
+				}
+			}
+		});
+	}
+
+	std::pair<glm::ivec2, glm::ivec2> getRange(const Particles& particles,
+	                                           int              id) const {
+		const auto  p = particles.getPosition(id) - origin;
+		const float r = particles.radius[id] + margin;
+		return {clampCell({static_cast<int>(std::floor((p.x - r) / CellSize)),
+		                   static_cast<int>(std::floor((p.y - r) / CellSize))}),
+		        clampCell({static_cast<int>(std::floor((p.x + r) / CellSize)),
+		                   static_cast<int>(std::floor((p.y + r) / CellSize))})};
+	}
+
+	glm::ivec2 clampCell(glm::ivec2 cell) const {
+		return glm::clamp(cell, glm::ivec2(0), dimensions - glm::ivec2(1));
+	}
+
+	// Each object is owned by the first cell of its range. Solving an object
+	// only touches objects owned by cells at most `span` cells away.
+	bool isOwner(int id, int x, int y) const {
+		return rangeMin[id].x == x && rangeMin[id].y == y;
+	}
+
+	// Calls fn once for every object sharing a cell with `id`. Objects that
+	// share several cells are only reported from the first shared cell.
+	template <typename Fn>
+	void apply(int id, Fn fn) const {
+		const auto min = rangeMin[id];
+		const auto max = rangeMax[id];
+		for (int y = min.y; y <= max.y; ++y) {
+			for (int x = min.x; x <= max.x; ++x) {
+				const int cell = x + y * dimensions.x;
+				for (int i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+					const int  other = cellObjects[i];
+					const auto first = glm::max(min, rangeMin[other]);
+					if (first.x == x && first.y == y) {
+						fn(other);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	std::vector<int> blockCounts;
+	std::vector<int> blockSpans;
+};
+
+class GridBroadphase : public Broadphase {
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		partition.build(particles, mapRadius, margin);
+
+		const int count = particles.size();
+		candidates.reset(count);
+		for (int i = 0; i < count; ++i) {
+			const glm::vec2 position = particles.getPosition(i);
+			const float     radius   = particles.radius[i] + margin;
+			candidates.beginRow(i);
+			if (i >= numAwake) continue;
+			partition.apply(i, [&](int id) {
+				if (id <= i) return;
+				const float range = radius + particles.radius[id] + margin;
+				const auto  d = glm::abs(position - particles.getPosition(id));
+				if (d.x <= range && d.y <= range) {
+					candidates.partners.push_back(id);
+				}
+			});
+		}
+		candidates.endRows(count);
+	}
+
+	const SpatialPartition* getPartition() const override { return &partition; }
+
+private:
+	SpatialPartition partition;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// Both counters only ever grow, the slot of a counter is its value modulo
+// the capacity.
+template <typename T, uint32_t Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0,
+	              "Capacity must be a power of two");
+
+public:
+	// Producer only. Fails when the queue is full.
+	bool push(T value) {
+		const uint32_t back = tail.load(std::memory_order_relaxed);
+		if (back - head.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+		slots[back & (Capacity - 1)] = std::move(value);
+		tail.store(back + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Fails when the queue is empty.
+	bool pop(T& value) {
+		const uint32_t front = head.load(std::memory_order_relaxed);
+		if (front == tail.load(std::memory_order_acquire)) return false;
+		value = std::move(slots[front & (Capacity - 1)]);
+		head.store(front + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	std::array<T, Capacity> slots;
+
+	alignas(64) std::atomic<uint32_t> head{0};
+	alignas(64) std::atomic<uint32_t> tail{0};
+};
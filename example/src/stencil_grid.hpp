@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+#include "spatial_partition.hpp"
+
+// Uniform grid where every particle lives in exactly one cell, the one that
+// contains its center. The cell size is grown to at least the largest
+// diameter, so colliding particles are always in the same or in neighboring
+// cells. Cells are paired with themselves and with half of their neighbors,
+// which visits every pair exactly once.
+class StencilGrid : public Broadphase {
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		build(particles, mapRadius, margin);
+
+		pairs.clear();
+		for (int y = 0; y < dimensions.y; ++y) {
+			for (int x = 0; x < dimensions.x; ++x) {
+				const int cell = x + y * dimensions.x;
+				if (cellStart[cell] == cellStart[cell + 1]) continue;
+
+				const auto objects = getObjects(cell);
+				findPairs(
+				    particles, numAwake, margin, objects, objects, pairs);
+				for (const auto& offset : HalfStencil) {
+					const int neighbor = getNeighbor(x, y, offset);
+					if (neighbor >= 0) {
+						findPairs(particles,
+						          numAwake,
+						          margin,
+						          objects,
+						          getObjects(neighbor),
+						          pairs);
+					}
+				}
+			}
+		}
+
+		candidates.assign(particles.size(), pairs);
+	}
+
+	void build(const Particles& particles, float mapRadius, float margin) {
+		const int count = particles.size();
+
+		float maxRadius = 0.f;
+		for (float r : particles.radius) {
+			maxRadius = std::max(maxRadius, r);
+		}
+		cellSize = std::max(CellSize, 2.f * (maxRadius + margin));
+
+		const float extent = mapRadius + cellSize;
+		origin             = glm::vec2(-extent, -extent);
+		dimensions         = glm::ivec2(
+		    std::max(1, static_cast<int>(std::ceil(2.f * extent / cellSize))));
+
+		const int numCells = dimensions.x * dimensions.y;
+		cellStart.assign(numCells + 1, 0);
+		cellOf.resize(count);
+		for (int id = 0; id < count; ++id) {
+			cellOf[id] = getCell(particles.getPosition(id));
+			++cellStart[cellOf[id]];
+		}
+		for (int i = 1; i <= numCells; ++i) {
+			cellStart[i] += cellStart[i - 1];
+		}
+		cellObjects.resize(count);
+		for (int id = count - 1; id >= 0; --id) {
+			cellObjects[--cellStart[cellOf[id]]] = id;
+		}
+	}
+
+	glm::ivec2 getDimensions() const { return dimensions; }
+
+	// Replaces `ids` with the particles of cell (x, y) followed by those of
+	// its half neighborhood and returns how many belong to the cell itself.
+	// Every pair that has at least one particle in the cell is then found
+	// exactly once within the tile.
+	int gatherTile(int x, int y, std::vector<int>& ids) const {
+		const int cell = x + y * dimensions.x;
+		ids.assign(cellObjects.begin() + cellStart[cell],
+		           cellObjects.begin() + cellStart[cell + 1]);
+		const int own = static_cast<int>(ids.size());
+		if (own == 0) return 0;
+
+		for (const auto& offset : HalfStencil) {
+			const int neighbor = getNeighbor(x, y, offset);
+			if (neighbor >= 0) {
+				ids.insert(ids.end(),
+				           cellObjects.begin() + cellStart[neighbor],
+				           cellObjects.begin() + cellStart[neighbor + 1]);
+			}
+		}
+		return own;
+	}
+
+private:
+	int getNeighbor(int x, int y, glm::ivec2 offset) const {
+		const glm::ivec2 neighbor = glm::ivec2(x, y) + offset;
+		if (neighbor.x < 0 || neighbor.x >= dimensions.x ||
+		    neighbor.y >= dimensions.y) {
+			return -1;
+		}
+		return neighbor.x + neighbor.y * dimensions.x;
+	}
+
+	int getCell(glm::vec2 p) const {
+		const glm::ivec2 cell =
+		    glm::clamp(glm::ivec2(glm::floor((p - origin) / cellSize)),
+		               glm::ivec2(0),
+		               dimensions - glm::ivec2(1));
+		return cell.x + cell.y * dimensions.x;
+	}
+
+	std::span<const int> getObjects(int cell) const {
+		return {cellObjects.data() + cellStart[cell],
+		        cellObjects.data() + cellStart[cell + 1]};
+	}
+
+	float                            cellSize   = 0.f;
+	glm::vec2                        origin     = {};
+	glm::ivec2                       dimensions = {};
+	std::vector<int>                 cellStart;
+	std::vector<int>                 cellObjects;
+	std::vector<int>                 cellOf;
+	std::vector<std::pair<int, int>> pairs;
+};
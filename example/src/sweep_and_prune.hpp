@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+
+// Sweep and prune along the x axis. The particles stay sorted by the left
+// edge of their bounding box between calls and the order is repaired with an
+// insertion sort, which is close to linear since it barely changes between
+// substeps.
+class SweepAndPrune : public Broadphase {
+public:
+	void findCandidates(const Particles& particles,
+	                    int              numAwake,
+	                    float            mapRadius,
+	                    float            margin,
+	                    CandidateList&   candidates) override {
+		(void)mapRadius;
+
+		const auto left = [&](int id) {
+			return particles.currentX[id] - particles.radius[id] - margin;
+		};
+
+		const int count = particles.size();
+		if (updateOrder(count)) {
+			std::sort(order.begin(), order.end(), [&](int a, int b) {
+				return left(a) < left(b);
+			});
+		}
+
+		minX.resize(count);
+		for (int k = 0; k < count; ++k) {
+			minX[k] = left(order[k]);
+		}
+		insertionSort();
+
+		pairs.clear();
+		for (int k = 0; k < count; ++k) {
+			const int   a    = order[k];
+			const float r    = particles.radius[a] + margin;
+			const float maxX = particles.currentX[a] + r;
+			const float y    = particles.currentY[a];
+			for (int l = k + 1; l < count && minX[l] <= maxX; ++l) {
+				const int b = order[l];
+				if (a >= numAwake && b >= numAwake) continue;
+
+				const float range = r + particles.radius[b] + margin;
+				if (std::abs(particles.currentY[b] - y) <= range) {
+					pairs.emplace_back(std::min(a, b), std::max(a, b));
+				}
+			}
+		}
+
+		candidates.assign(count, pairs);
+	}
+
+	void invalidate() override { order.clear(); }
+
+private:
+	// Appends newly added particles to the order, or starts over if it no
+	// longer matches the particles. Returns true when it was started over.
+	bool updateOrder(int count) {
+		const int previous = static_cast<int>(order.size());
+		if (previous == 0 || count < previous) {
+			order.resize(count);
+			std::iota(order.begin(), order.end(), 0);
+			return true;
+		}
+		for (int id = previous; id < count; ++id) {
+			order.push_back(id);
+		}
+		return false;
+	}
+
+	void insertionSort() {
+		const int count = static_cast<int>(order.size());
+		for (int k = 1; k < count; ++k) {
+			const float key = minX[k];
+			const int   id  = order[k];
+
+			int l = k - 1;
+			for (; l >= 0 && minX[l] > key; --l) {
+				minX[l + 1]  = minX[l];
+				order[l + 1] = order[l];
+			}
+			minX[l + 1]  = key;
+			order[l + 1] = id;
+		}
+	}
+
+	std::vector<int>                 order;
+	std::vector<float>               minX;
+	std::vector<std::pair<int, int>> pairs;
+};
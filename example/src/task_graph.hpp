@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "task_scheduler.hpp"
+
+// A fixed set of stages with declared dependencies, built once and launched
+// every frame. A stage is handed to the scheduler as soon as the last stage
+// it depends on has finished, stages without a path between them run
+// concurrently.
+class TaskGraph {
+public:
+	explicit TaskGraph(TaskScheduler& owner)
+	    : group(owner) {}
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+	~TaskGraph() { wait(); }
+
+	// Dependencies must have been added before, so the graph has no cycles.
+	int addNode(std::function<void()>      fn,
+	            std::initializer_list<int> dependencies = {}) {
+		const int id   = static_cast<int>(nodes.size());
+		Node&     node = nodes.emplace_back();
+
+		node.fn              = std::move(fn);
+		node.numDependencies = static_cast<int>(dependencies.size());
+		for (int dependency : dependencies) {
+			nodes[dependency].successors.push_back(id);
+		}
+		return id;
+	}
+
+	// Starts every stage, the caller is free to do other work until wait().
+	void launch() {
+		wait();
+		for (Node& node : nodes) {
+			node.remaining.store(node.numDependencies,
+			                     std::memory_order_relaxed);
+		}
+		for (int id = 0; id < static_cast<int>(nodes.size()); ++id) {
+			if (nodes[id].numDependencies == 0) {
+				group.spawn([this, id] { runNode(id); });
+			}
+		}
+	}
+
+	// Returns once every stage of the last launch has finished, running
+	// stages on the calling thread in the meantime.
+	void wait() { group.wait(); }
+
+	void run() {
+		launch();
+		wait();
+	}
+
+private:
+	struct Node {
+		std::function<void()> fn;
+		std::vector<int>      successors;
+		int                   numDependencies = 0;
+		std::atomic<int>      remaining{0};
+	};
+
+	void runNode(int id) {
+		Node& node = nodes[id];
+		node.fn();
+		for (int successor : node.successors) {
+			if (nodes[successor].remaining.fetch_sub(
+			        1, std::memory_order_acq_rel) == 1) {
+				group.spawn([this, successor] { runNode(successor); });
+			}
+		}
+	}
+
+	TaskGroup        group;
+	std::deque<Node> nodes;
+};
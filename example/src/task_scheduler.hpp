@@ -0,0 +1,390 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#	if !defined(NOMINMAX)
+#		define NOMINMAX
+#	endif
+#	if !defined(WIN32_LEAN_AND_MEAN)
+#		define WIN32_LEAN_AND_MEAN
+#	endif
+#	include <windows.h>
+#elif defined(__linux__)
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#	include <immintrin.h>
+#endif
+
+class TaskScheduler;
+
+// Tracks a set of tasks until all of them have finished. Waiting runs other
+// tasks in the meantime instead of blocking, so tasks can wait on groups of
+// their own. Threads outside the pool only run tasks of the group they wait
+// on, so waiting on the UI thread never picks up work of the simulation.
+class TaskGroup {
+public:
+	explicit TaskGroup(TaskScheduler& owner)
+	    : scheduler(owner) {}
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+	~TaskGroup() { wait(); }
+
+	template <typename Fn>
+	void spawn(Fn fn);
+
+	void wait();
+
+	bool isDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class TaskScheduler;
+
+	TaskScheduler&                    scheduler;
+	std::atomic<int>                  pending{0};
+	std::mutex                        functionsMutex;
+	std::deque<std::function<void()>> functions;
+};
+
+// Work-stealing scheduler. Every worker owns a queue, it runs its newest
+// task first and, once that is empty, steals the oldest task of another
+// queue. Threads outside the pool share one extra queue. Loops are split in
+// halves lazily, so thieves take the largest remaining ranges and busy
+// workers never pay for splits nobody needed.
+//
+// Idle workers spin for a short while, which keeps the gaps between the
+// parallel loops of a frame cheap, then sleep until new tasks arrive.
+class TaskScheduler {
+	static constexpr int SpinCount = 4096;
+
+	struct Task {
+		void (*run)(void* context, int begin, int end) = nullptr;
+
+		void*      context = nullptr;
+		int        begin   = 0;
+		int        end     = 0;
+		int        grain   = 1;
+		TaskGroup* group   = nullptr;
+	};
+
+	struct alignas(64) Queue {
+		std::mutex       mutex;
+		std::deque<Task> tasks;
+		std::atomic<int> size{0};
+	};
+
+public:
+	// `numThreads` includes the calling thread, which runs tasks while it
+	// waits. Zero uses one thread per hardware thread.
+	explicit TaskScheduler(int numThreads = 0, bool pinThreads = false) {
+		start(numThreads, pinThreads);
+	}
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+	~TaskScheduler() { stop(); }
+
+	// Replaces the workers. Must not be called while tasks are running.
+	void configure(int numThreads, bool pinThreads) {
+		stop();
+		start(numThreads, pinThreads);
+	}
+
+	int  getNumThreads() const { return static_cast<int>(queues.size()); }
+	bool getPinThreads() const { return pinned; }
+
+	static int getHardwareThreads() {
+		const unsigned hardware = std::thread::hardware_concurrency();
+		return std::max(1, static_cast<int>(hardware));
+	}
+
+	// Calls fn(begin, end) for disjoint ranges covering [begin, end) that are
+	// at most `grain` long, zero picks a grain from the number of threads.
+	template <typename Fn>
+	void parallelForRange(int begin, int end, int grain, Fn fn) {
+		if (begin >= end) return;
+		if (grain <= 0) {
+			grain = std::max(1, (end - begin) / (getNumThreads() * 8));
+		}
+		if (workers.empty() || end - begin <= grain) {
+			fn(begin, end);
+			return;
+		}
+
+		TaskGroup group(*this);
+		group.pending.store(1, std::memory_order_relaxed);
+		execute({&invokeRange<Fn>, &fn, begin, end, grain, &group});
+		group.wait();
+	}
+
+	template <typename Fn>
+	void parallelFor(int begin, int end, int grain, Fn fn) {
+		parallelForRange(begin, end, grain, [&](int rangeBegin, int rangeEnd) {
+			for (int i = rangeBegin; i < rangeEnd; ++i) {
+				fn(i);
+			}
+		});
+	}
+
+	template <typename Fn>
+	void parallelFor(int begin, int end, Fn fn) {
+		parallelFor(begin, end, 0, fn);
+	}
+
+	// Sums fn(i) over [begin, end).
+	template <typename Fn>
+	int parallelSum(int begin, int end, int grain, Fn fn) {
+		std::atomic<int> sum{0};
+		parallelForRange(begin, end, grain, [&](int rangeBegin, int rangeEnd) {
+			int partial = 0;
+			for (int i = rangeBegin; i < rangeEnd; ++i) {
+				partial += fn(i);
+			}
+			sum.fetch_add(partial, std::memory_order_relaxed);
+		});
+		return sum.load(std::memory_order_relaxed);
+	}
+
+	template <typename Fn>
+	int parallelSum(int begin, int end, Fn fn) {
+		return parallelSum(begin, end, 0, fn);
+	}
+
+private:
+	friend class TaskGroup;
+
+	template <typename Fn>
+	static void invokeRange(void* context, int begin, int end) {
+		(*static_cast<Fn*>(context))(begin, end);
+	}
+
+	static void invokeFunction(void* context, int, int) {
+		(*static_cast<std::function<void()>*>(context))();
+	}
+
+	static void relax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+		_mm_pause();
+#else
+		std::this_thread::yield();
+#endif
+	}
+
+	static void pinCurrentThread(int cpu) {
+		cpu %= getHardwareThreads();
+#if defined(_WIN32)
+		if (cpu < 64) {
+			SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+		}
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+		(void)cpu;
+#endif
+	}
+
+	void start(int numThreads, bool pinThreads) {
+		const int total = numThreads > 0 ? numThreads : getHardwareThreads();
+		pinned          = pinThreads;
+		stopping        = false;
+
+		queues.clear();
+		for (int i = 0; i < total; ++i) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+		for (int i = 0; i + 1 < total; ++i) {
+			workers.emplace_back([this, i] { workerMain(i); });
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard lock(sleepMutex);
+			stopping = true;
+		}
+		sleepCondition.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	// Workers use their own queue, every other thread the last one.
+	int getQueueIndex() const {
+		return isWorker() ? currentWorker : static_cast<int>(workers.size());
+	}
+
+	void push(const Task& task) {
+		Queue& queue = *queues[getQueueIndex()];
+		{
+			std::lock_guard lock(queue.mutex);
+			queue.tasks.push_back(task);
+			queue.size.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		epoch.fetch_add(1);
+		if (numSleeping.load() > 0) {
+			std::lock_guard lock(sleepMutex);
+			sleepCondition.notify_one();
+		}
+	}
+
+	bool isWorker() const { return currentScheduler == this; }
+
+	// Takes the newest task of the own queue or the oldest of another one.
+	// With `only` set, skips every task that belongs to a different group.
+	bool findTask(int self, Task& task, const TaskGroup* only = nullptr) {
+		const int count = static_cast<int>(queues.size());
+		for (int k = 0; k < count; ++k) {
+			Queue& queue = *queues[(self + k) % count];
+			if (queue.size.load(std::memory_order_relaxed) == 0) continue;
+
+			std::lock_guard lock(queue.mutex);
+			if (queue.tasks.empty()) continue;
+			if (only) {
+				if (!takeFromGroup(queue, k == 0, only, task)) continue;
+			} else if (k == 0) {
+				task = queue.tasks.back();
+				queue.tasks.pop_back();
+			} else {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+			queue.size.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	// Expects the queue to be locked.
+	static bool takeFromGroup(Queue&           queue,
+	                          bool             newest,
+	                          const TaskGroup* group,
+	                          Task&            task) {
+		const int count = static_cast<int>(queue.tasks.size());
+		for (int k = 0; k < count; ++k) {
+			const int i = newest ? count - 1 - k : k;
+			if (queue.tasks[i].group != group) continue;
+			task = queue.tasks[i];
+			queue.tasks.erase(queue.tasks.begin() + i);
+			return true;
+		}
+		return false;
+	}
+
+	// Hands the upper halves of the range to other threads until the rest
+	// fits the grain, then runs it. The group must not be touched after its
+	// counter is released, its owner may return right away.
+	void execute(Task task) {
+		while (task.end - task.begin > task.grain) {
+			const int mid = task.begin + (task.end - task.begin) / 2;
+			task.group->pending.fetch_add(1, std::memory_order_relaxed);
+			push({task.run,
+			      task.context,
+			      mid,
+			      task.end,
+			      task.grain,
+			      task.group});
+			task.end = mid;
+		}
+		task.run(task.context, task.begin, task.end);
+		task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+	}
+
+	void workerMain(int index) {
+		currentScheduler = this;
+		currentWorker    = index;
+		if (pinned) pinCurrentThread(index + 1);
+
+		int idle = 0;
+		while (true) {
+			Task task;
+			if (findTask(index, task)) {
+				execute(task);
+				idle = 0;
+				continue;
+			}
+			if (++idle < SpinCount) {
+				relax();
+				continue;
+			}
+
+			// Tasks pushed after this point bump the epoch, which either
+			// keeps this worker awake or wakes it up again
+			const uint64_t seen = epoch.load();
+			if (findTask(index, task)) {
+				execute(task);
+				idle = 0;
+				continue;
+			}
+			std::unique_lock lock(sleepMutex);
+			if (stopping) return;
+			numSleeping.fetch_add(1);
+			sleepCondition.wait(
+			    lock, [&] { return stopping || epoch.load() != seen; });
+			numSleeping.fetch_sub(1);
+			idle = 0;
+		}
+	}
+
+	inline static thread_local const TaskScheduler* currentScheduler = nullptr;
+	inline static thread_local int                  currentWorker    = 0;
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread>            workers;
+	bool                                pinned = false;
+
+	std::mutex              sleepMutex;
+	std::condition_variable sleepCondition;
+	bool                    stopping = false;
+	std::atomic<uint64_t>   epoch{0};
+	std::atomic<int>        numSleeping{0};
+};
+
+template <typename Fn>
+void TaskGroup::spawn(Fn fn) {
+	std::function<void()>* function = nullptr;
+	{
+		std::lock_guard lock(functionsMutex);
+		function = &functions.emplace_back(std::move(fn));
+	}
+	pending.fetch_add(1, std::memory_order_relaxed);
+	scheduler.push({&TaskScheduler::invokeFunction, function, 0, 0, 1, this});
+}
+
+inline void TaskGroup::wait() {
+	const int        self = scheduler.getQueueIndex();
+	const TaskGroup* only = scheduler.isWorker() ? nullptr : this;
+	while (!isDone()) {
+		TaskScheduler::Task task;
+		if (scheduler.findTask(self, task, only)) {
+			scheduler.execute(task);
+		} else {
+			TaskScheduler::relax();
+		}
+	}
+	std::lock_guard lock(functionsMutex);
+	functions.clear();
+}
+
+// The scheduler shared by the solver and the renderer.
+inline TaskScheduler& getTaskScheduler() {
+	static TaskScheduler scheduler;
+	return scheduler;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+// Hands the newest value from one writer thread to one reader thread without
+// either of them waiting. The writer fills its own slot and swaps it with
+// the shared one, the reader swaps its slot with the shared one whenever
+// that holds a value it has not seen yet. Values the reader never picked up
+// are overwritten.
+template <typename T>
+class TripleBuffer {
+	static constexpr int IndexMask = 0x3;
+	static constexpr int FreshBit  = 0x4;
+
+public:
+	// Writer only. The slot keeps the contents it had when it was last
+	// handed over, so it can be reused without reallocating.
+	T& getWriteBuffer() { return slots[writeIndex]; }
+
+	// Writer only. Makes the write buffer the newest value.
+	void publish() {
+		const int previous =
+		    shared.exchange(writeIndex | FreshBit, std::memory_order_acq_rel);
+		writeIndex = previous & IndexMask;
+	}
+
+	// Reader only. Returns the newest published value, which stays valid
+	// until the next call.
+	const T& read() {
+		if (shared.load(std::memory_order_relaxed) & FreshBit) {
+			const int previous =
+			    shared.exchange(readIndex, std::memory_order_acq_rel);
+			readIndex = previous & IndexMask;
+		}
+		return slots[readIndex];
+	}
+
+private:
+	std::array<T, 3> slots;
+
+	alignas(64) int writeIndex = 0;
+	alignas(64) std::atomic<int> shared{1};
+	alignas(64) int readIndex = 2;
+};
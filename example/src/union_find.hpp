@@ -0,0 +1,38 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+// Disjoint sets over the indices [0, count). Sets are merged by size and
+// paths are halved on every lookup.
+class UnionFind {
+public:
+	void reset(int count) {
+		parent.resize(count);
+		size.assign(count, 1);
+		for (int i = 0; i < count; ++i) {
+			parent[i] = i;
+		}
+	}
+
+	int find(int i) {
+		while (parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i         = parent[i];
+		}
+		return i;
+	}
+
+	void unite(int a, int b) {
+		a = find(a);
+		b = find(b);
+		if (a == b) return;
+		if (size[a] < size[b]) std::swap(a, b);
+		parent[b] = a;
+		size[a] += size[b];
+	}
+
+private:
+	std::vector<int> parent;
+	std::vector<int> size;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "broadphase.hpp"
+#include "particles.hpp"
+
+// Compliant contact constraints in the style of XPBD. Every candidate pair
+// keeps a Lagrange multiplier, the accumulated contact force, which is
+// carried over to the same pair in the next substep. A resting contact then
+// starts out already loaded and settles at the compression that matches its
+// compliance, instead of being projected apart from scratch every substep.
+class XpbdContacts {
+public:
+	void invalidate() {
+		previousStart.clear();
+		previousPartners.clear();
+		previousLambdas.clear();
+	}
+
+	// Looks up the multipliers of the previous substep for every pair in
+	// `contacts`. Rows only hold a handful of partners, so they are matched
+	// with a linear search.
+	void beginStep(const CandidateList& contacts, float warmStart) {
+		const int count = static_cast<int>(contacts.partnerStart.size()) - 1;
+		const int previousCount = static_cast<int>(previousStart.size()) - 1;
+
+		lambdas.assign(contacts.size(), 0.f);
+		for (int id = 0; id < std::min(count, previousCount); ++id) {
+			const auto begin = previousPartners.begin() + previousStart[id];
+			const auto end   = previousPartners.begin() + previousStart[id + 1];
+			for (int i = contacts.partnerStart[id];
+			     i < contacts.partnerStart[id + 1];
+			     ++i) {
+				const auto p = std::find(begin, end, contacts.partners[i]);
+				if (p != end) {
+					lambdas[i] =
+					    warmStart * previousLambdas[p - previousPartners.begin()];
+				}
+			}
+		}
+	}
+
+	void endStep(const CandidateList& contacts) {
+		previousStart    = contacts.partnerStart;
+		previousPartners = contacts.partners;
+		previousLambdas.swap(lambdas);
+	}
+
+	// One Gauss-Seidel pass over the rows of the first `count` particles.
+	// Particles weigh as much as their area. Every change of a multiplier
+	// moves the particles by the matching amount, and multipliers never go
+	// below zero, so contacts push but never pull.
+	int solve(Particles&           particles,
+	          const CandidateList& contacts,
+	          int                  count,
+	          float                compliance,
+	          float                dt) {
+		const float alpha = compliance / (dt * dt);
+
+		int collisions = 0;
+		for (int id = 0; id < count; ++id) {
+			const float ra = particles.radius[id];
+			const float wa = 1.f / (ra * ra);
+			for (int i = contacts.partnerStart[id];
+			     i < contacts.partnerStart[id + 1];
+			     ++i) {
+				const int   other   = contacts.partners[i];
+				const float rb      = particles.radius[other];
+				const auto  axis    = particles.getPosition(id) -
+				                  particles.getPosition(other);
+				const float dist2   = glm::dot(axis, axis);
+				const float minDist = ra + rb;
+				float&      lambda  = lambdas[i];
+				if (dist2 >= minDist * minDist || dist2 == 0.f) {
+					lambda = 0.f;
+					continue;
+				}
+
+				const float dist = std::sqrt(dist2);
+				const float c    = dist - minDist;
+				const float wb   = 1.f / (rb * rb);
+				const float deltaLambda =
+				    std::max((-c - alpha * lambda) / (wa + wb + alpha), -lambda);
+				lambda += deltaLambda;
+				++collisions;
+
+				const glm::vec2 n = axis / dist;
+				particles.setPosition(
+				    id, particles.getPosition(id) + n * (wa * deltaLambda));
+				particles.setPosition(
+				    other,
+				    particles.getPosition(other) - n * (wb * deltaLambda));
+			}
+		}
+		return collisions;
+	}
+
+private:
+	std::vector<float> lambdas;
+	std::vector<int>   previousStart;
+	std::vector<int>   previousPartners;
+	std::vector<float> previousLambdas;
+};